@@ -99,10 +99,10 @@ int main(int argc, char **argv)
   // set matrix dimensions and allocate memory for matrices
   printf(" ndim = %d\n",Ndim);
 
-  A    = (TYPE *) malloc(Ndim*Ndim*sizeof(TYPE));
-  b    = (TYPE *) malloc(Ndim*sizeof(TYPE));
-  x1   = (TYPE *) malloc(Ndim*sizeof(TYPE));
-  x2   = (TYPE *) malloc(Ndim*sizeof(TYPE));
+  A    = (TYPE *) mm_malloc(Ndim*Ndim*sizeof(TYPE));
+  b    = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+  x1   = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+  x2   = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
   conv_tmp   = (TYPE *) malloc(Ndim/conv_wgsize*sizeof(TYPE));
 
   if (!A || !b || !x1 || !x2)
@@ -113,6 +113,7 @@ int main(int argc, char **argv)
 
   // generate our diagonally dominant matrix, A
   init_diag_dom_near_identity_matrix(Ndim, A);
+  mm_alloc_report("A", A);
 
 #ifdef VERBOSE
   mm_print(Ndim, Ndim, A);
@@ -309,10 +310,10 @@ int main(int argc, char **argv)
   if (err > TOLERANCE)
     printf("\nWARNING: final solution error > %g\n\n", TOLERANCE);
 
-  free(A);
-  free(b);
-  free(x1);
-  free(x2);
+  mm_free(A);
+  mm_free(b);
+  mm_free(x1);
+  mm_free(x2);
 
   // Release OpenCL objects
   clReleaseMemObject(d_A);
@@ -20,7 +20,7 @@ void mm_tst_cases(int NTRIALS, int Ndim, int Mdim, int Pdim,
    double min_t, max_t, ave_t;
    TYPE *Cref;
 
-   Cref = (TYPE *) malloc (Ndim * Mdim * sizeof(TYPE));
+   Cref = (TYPE *) mm_malloc (Ndim * Mdim * sizeof(TYPE));
 
    /* Initialize matrices */
 
@@ -84,4 +84,6 @@ void mm_tst_cases(int NTRIALS, int Ndim, int Mdim, int Pdim,
 
    ave_t = ave_t/(double)NTRIALS;
    output_results(Ndim, Mdim, Pdim, nerr, ave_t, min_t, max_t);
+
+   mm_free(Cref);
 }
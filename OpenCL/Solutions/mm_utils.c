@@ -2,7 +2,16 @@
 // This is a set of simple utility routines and test
 // generators for my matrix multiplication test bed.
 //
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // for MAP_ANONYMOUS, MAP_HUGETLB and MADV_HUGEPAGE
+#endif
 #include "mm_utils.h"
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
 
 //
 // Compare two matrices ... return the sum of the squares 
@@ -31,6 +40,135 @@ void mm_clear(int Ndim, int Mdim, TYPE *C){
            *(C+i*Mdim+j) = (TYPE) 0.0;
 }
 
+//=========================================================
+// Aligned, huge page backed allocation for the big arrays.
+//
+// mm_malloc returns MM_ALIGN aligned memory (a cache line, and a
+// full AVX-512 vector).  Allocations of at least MM_HUGE_PAGE bytes
+// try, in order,
+//    explicit huge pages   (mmap with MAP_HUGETLB, needs pages
+//                           reserved in /proc/sys/vm/nr_hugepages)
+//    transparent huge pages (huge page aligned, madvise MADV_HUGEPAGE)
+//    ordinary pages
+// and smaller ones just get ordinary aligned pages.  The pages are
+// not touched here, so first touch placement still works.  What was
+// obtained is kept in front of the buffer for mm_free and
+// mm_alloc_report.  Free with mm_free, never with free.
+//=========================================================
+enum { MM_SMALL_PAGES, MM_TRANSPARENT_HUGE_PAGES, MM_EXPLICIT_HUGE_PAGES };
+
+typedef struct {
+   size_t bytes;      // size requested
+   size_t mapped;     // size of the underlying allocation
+   int    kind;
+} mm_header;
+
+void *mm_malloc(size_t bytes){
+   size_t total = bytes + MM_ALIGN;
+   char  *base  = NULL;
+   int    kind  = MM_SMALL_PAGES;
+   mm_header *h;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+   if (total >= MM_HUGE_PAGE){
+      size_t len = (total + MM_HUGE_PAGE - 1)/MM_HUGE_PAGE*MM_HUGE_PAGE;
+      void  *p   = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED){
+         base  = (char *) p;
+         total = len;
+         kind  = MM_EXPLICIT_HUGE_PAGES;
+      }
+   }
+#endif
+   if (!base){
+#if defined(_WIN32)
+      base = (char *) _aligned_malloc(total, MM_ALIGN);
+#else
+      size_t align = MM_ALIGN;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      if (total >= MM_HUGE_PAGE) align = MM_HUGE_PAGE;
+#endif
+      if (posix_memalign((void **) &base, align, total)) base = NULL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      if (base && align == MM_HUGE_PAGE &&
+          !madvise(base, total, MADV_HUGEPAGE))
+         kind = MM_TRANSPARENT_HUGE_PAGES;
+#endif
+#endif
+      if (!base) return NULL;
+   }
+
+   h = (mm_header *) base;
+   h->bytes  = bytes;
+   h->mapped = total;
+   h->kind   = kind;
+   return base + MM_ALIGN;
+}
+
+void mm_free(void *p){
+   mm_header *h;
+   if (!p) return;
+   h = (mm_header *) ((char *) p - MM_ALIGN);
+#if defined(__linux__) && defined(MAP_HUGETLB)
+   if (h->kind == MM_EXPLICIT_HUGE_PAGES){
+      munmap(h, h->mapped);
+      return;
+   }
+#endif
+#if defined(_WIN32)
+   _aligned_free(h);
+#else
+   free(h);
+#endif
+}
+
+#if defined(__linux__)
+//
+// KB of the mapping holding p that the kernel has actually backed
+// with transparent huge pages, or -1 if that can't be found out.
+//
+static long mm_thp_kb(const void *p){
+   FILE *f = fopen("/proc/self/smaps", "r");
+   char  line[256];
+   unsigned long lo, hi;
+   long  kb = -1;
+   int   in = 0;
+   if (!f) return -1;
+   while (fgets(line, sizeof(line), f)){
+      if (sscanf(line, "%lx-%lx", &lo, &hi) == 2)
+         in = ((unsigned long) p >= lo && (unsigned long) p < hi);
+      else if (in && sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+         break;
+   }
+   fclose(f);
+   return kb;
+}
+#endif
+
+//
+// Print what mm_malloc obtained for buffer p.  Transparent huge pages
+// are only handed out as the pages are touched, so call this after
+// the buffer has been filled in.
+//
+void mm_alloc_report(const char *name, const void *p){
+   static const char *kinds[] = {
+      "ordinary pages", "transparent huge pages", "explicit huge pages"
+   };
+   const mm_header *h;
+   long  kb = -1;
+   if (!p) return;
+   h = (const mm_header *) ((const char *) p - MM_ALIGN);
+   printf(" %s: %.1f MB, %d-byte aligned, %s", name,
+          (double) h->bytes/(1024.0*1024.0), MM_ALIGN, kinds[h->kind]);
+#if defined(__linux__)
+   if (h->kind == MM_TRANSPARENT_HUGE_PAGES) kb = mm_thp_kb(p);
+#endif
+   if (kb >= 0)
+      printf(" (%.1f MB on huge pages)", (double) kb/1024.0);
+   printf("\n");
+}
+
 //
 //  Print the elements of a matrix to standard out
 //  (might be useful for debugging).
@@ -14,6 +14,16 @@ double errsqr (int Ndim, int Mdim, TYPE* C, TYPE* Cref);
 
 void mm_clear (int Ndim, int Mdim, TYPE* C); 
 
+// aligned, huge page backed allocation for big arrays (see mm_utils.c)
+#define MM_ALIGN       64
+#define MM_HUGE_PAGE   (2*1024*1024)
+
+void *mm_malloc (size_t bytes);
+
+void  mm_free (void *p);
+
+void  mm_alloc_report (const char *name, const void *p);
+
 void mm_print (int Ndim, int Mdim, TYPE* C); 
 
 void init_const_matrix (int Ndim,  int Mdim,  int Pdim, 
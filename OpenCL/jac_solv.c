@@ -63,10 +63,10 @@ int main(int argc, char **argv)
 
    printf(" ndim = %d\n",Ndim);
 
-   A    = (TYPE *) malloc(Ndim*Ndim*sizeof(TYPE));
-   b    = (TYPE *) malloc(Ndim*sizeof(TYPE));
-   x1   = (TYPE *) malloc(Ndim*sizeof(TYPE));
-   x2   = (TYPE *) malloc(Ndim*sizeof(TYPE));
+   A    = (TYPE *) mm_malloc(Ndim*Ndim*sizeof(TYPE));
+   b    = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+   x1   = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+   x2   = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
 
    if (!A || !b || !x1 || !x2)
    {
@@ -76,6 +76,7 @@ int main(int argc, char **argv)
 
    // generate our diagonally dominant matrix, A
    init_diag_dom_near_identity_matrix(Ndim, A);
+   mm_alloc_report("A", A);
 
 #ifdef VERBOSE
    mm_print(Ndim, Ndim, A);
@@ -167,8 +168,8 @@ int main(int argc, char **argv)
    printf("jacobi solver: err = %f, solution checksum = %f \n",
                                (float)sqrt(err), (float)chksum);
 
-  free(A);
-  free(b);
-  free(x1);
-  free(x2);
+  mm_free(A);
+  mm_free(b);
+  mm_free(x1);
+  mm_free(x2);
 }
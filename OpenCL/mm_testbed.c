@@ -61,12 +61,22 @@ int main(int argc, char **argv)
       Mdim = 3*SIZE;
    }
 
-   A    = (TYPE *) malloc(Ndim*Pdim*sizeof(TYPE));
-   B    = (TYPE *) malloc(Pdim*Mdim*sizeof(TYPE));
-   C    = (TYPE *) malloc(Ndim*Mdim*sizeof(TYPE));
+   A    = (TYPE *) mm_malloc(Ndim*Pdim*sizeof(TYPE));
+   B    = (TYPE *) mm_malloc(Pdim*Mdim*sizeof(TYPE));
+   C    = (TYPE *) mm_malloc(Ndim*Mdim*sizeof(TYPE));
+   if (!A || !B || !C)
+   {
+        printf("\n memory allocation error\n");
+        exit(-1);
+   }
 
    printf("\n==================================================\n");
    printf(" triple loop, ijk case %d %d %d\n", Ndim, Mdim, Pdim);
    mm_tst_cases(NTRIALS, Ndim, Mdim, Pdim, A, B, C, &mm_ijk);
+   mm_alloc_report("A", A);
+
+   mm_free(A);
+   mm_free(B);
+   mm_free(C);
 
 }
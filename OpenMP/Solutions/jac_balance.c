@@ -0,0 +1,146 @@
+//
+// Nonzero balanced partitioning of a CSR sweep.  See jac_balance.h.
+//
+#include "jac_balance.h"
+
+// the cost of rows 0 to i-1
+#define BAL_COST(row_start,i) \
+        ((row_start)[i] + (size_t)(i)*JAC_BAL_ROW_COST)
+
+//
+// The end of a chunk starting at row lo: the last hi with rows lo
+// to hi-1 costing no more than target, but at least lo+1
+//
+static int bal_rows(int Ndim, const size_t *row_start, int lo,
+                    size_t target)
+{
+   int  l = lo+1, h = Ndim, m;
+   size_t limit = BAL_COST(row_start, lo) + target;
+
+   while (l < h){
+      m = l + (h-l+1)/2;
+      if (BAL_COST(row_start, m) <= limit) l = m;
+      else                                 h = m-1;
+   }
+   return l;
+}
+
+//
+// Walk the rows cutting chunks.  With fill clear this only counts
+// them, so the arrays can be allocated.
+//
+static int bal_cut(jac_balance *bl, int Ndim, const size_t *row_start,
+                   size_t target, int fill)
+{
+   int  i = 0, hi, p, np, c = 0;
+   size_t n;
+
+   while (i < Ndim){
+      n = row_start[i+1] - row_start[i];
+      if (n > target){
+         // a long row, cut into pieces of about target nonzeros
+         np = (int)((n + target - 1)/target);
+         for (p=0; p<np; p++, c++){
+            if (!fill) continue;
+            bl->lo[c]      = i;
+            bl->hi[c]      = i+1;
+            bl->k0[c]      = row_start[i] + n*p/np;
+            bl->k1[c]      = row_start[i] + n*(p+1)/np;
+            bl->head[c]    = c-p;
+            bl->npieces[c] = np;
+            bl->left[c]    = np;
+         }
+         i++;
+      }
+      else {
+         hi = bal_rows(Ndim, row_start, i, target);
+         if (fill){
+            bl->lo[c]      = i;
+            bl->hi[c]      = hi;
+            bl->k0[c]      = row_start[i];
+            bl->k1[c]      = row_start[hi];
+            bl->head[c]    = -1;
+            bl->npieces[c] = 0;
+            bl->left[c]    = 0;
+         }
+         c++;
+         i = hi;
+      }
+   }
+   return c;
+}
+
+jac_balance *jac_balance_create(int Ndim, const size_t *row_start, int nth)
+{
+   int  c, t, n;
+   size_t total, target, mid;
+   jac_balance *bl;
+
+   if (nth < 1) nth = 1;
+   total  = BAL_COST(row_start, Ndim);
+   target = total/((size_t)nth*JAC_BAL_CHUNKS);
+   if (target < JAC_BAL_MIN_CHUNK) target = JAC_BAL_MIN_CHUNK;
+
+   bl = (jac_balance *) malloc(sizeof(jac_balance));
+   if (!bl) return NULL;
+   n = bal_cut(bl, Ndim, row_start, target, 0);
+   bl->nth     = nth;
+   bl->nchunks = n;
+   bl->lo      = (int *) mm_malloc(n*sizeof(int));
+   bl->hi      = (int *) mm_malloc(n*sizeof(int));
+   bl->k0      = (size_t *) mm_malloc(n*sizeof(size_t));
+   bl->k1      = (size_t *) mm_malloc(n*sizeof(size_t));
+   bl->head    = (int *) mm_malloc(n*sizeof(int));
+   bl->npieces = (int *) mm_malloc(n*sizeof(int));
+   bl->left    = (int *) mm_malloc(n*sizeof(int));
+   bl->psum    = (TYPE *) mm_malloc(n*sizeof(TYPE));
+   bl->first   = (int *) mm_malloc((nth+1)*sizeof(int));
+   bl->next    = (int *) mm_malloc((size_t)2*nth*JAC_BAL_PAD*sizeof(int));
+   if (!bl->lo || !bl->hi || !bl->k0 || !bl->k1 || !bl->head ||
+       !bl->npieces || !bl->left || !bl->psum || !bl->first || !bl->next){
+      jac_balance_destroy(bl);
+      return NULL;
+   }
+   bal_cut(bl, Ndim, row_start, target, 1);
+
+   // each thread gets the chunks whose middle falls in its share of
+   // the total cost
+   for (c=0, t=0; t<nth; t++){
+      while (c < n){
+         mid = (bl->k0[c] + bl->k1[c])/2
+             + (size_t)bl->lo[c]*JAC_BAL_ROW_COST;
+         if ((double)mid*nth >= (double)total*t) break;
+         c++;
+      }
+      bl->first[t] = c;
+   }
+   bl->first[nth] = n;
+
+   jac_balance_reset(bl, 0);
+   jac_balance_reset(bl, 1);
+   return bl;
+}
+
+void jac_balance_destroy(jac_balance *bl)
+{
+   if (!bl) return;
+   mm_free(bl->lo);
+   mm_free(bl->hi);
+   mm_free(bl->k0);
+   mm_free(bl->k1);
+   mm_free(bl->head);
+   mm_free(bl->npieces);
+   mm_free(bl->left);
+   mm_free(bl->psum);
+   mm_free(bl->first);
+   mm_free(bl->next);
+   free(bl);
+}
+
+void jac_balance_reset(jac_balance *bl, int it)
+{
+   int  t;
+
+   for (t=0; t<bl->nth; t++)
+      JAC_BAL_NEXT(bl, it, t) = bl->first[t];
+}
@@ -0,0 +1,65 @@
+//
+// Nonzero balanced partitioning of a CSR matrix's sweep.  Splitting
+// the rows evenly by count leaves some threads with far more work
+// than others once the row lengths vary, as they do in matrices
+// with a power law spread of row lengths.  Here the rows are cut
+// into chunks of about the same cost, counted as nonzeros plus a
+// little for each row, found by binary search on row_start (which
+// is already a prefix sum of the row lengths).
+//
+// A row costing more than a chunk is cut into pieces of its own.
+// Each piece leaves its part of the row's sum in psum, and the
+// thread that finishes the row's last piece adds them up (in order,
+// so the answer doesn't depend on who did what) and makes xnew.
+//
+// The chunks are handed out to the threads in contiguous runs of
+// about equal cost.  Each thread takes its own chunks one at a time
+// from a shared counter, and when it runs out it takes chunks from
+// the other threads' counters, so a thread held up by a slow row
+// (or the operating system) has its work finished by the others.
+//
+#ifndef JAC_BALANCE_H
+#define JAC_BALANCE_H
+
+#include "mm_utils.h"
+
+// a row counts as this many nonzeros on top of its own
+#define JAC_BAL_ROW_COST   4
+
+// chunks per thread, so there is something left to steal, and the
+// smallest chunk worth taking from a shared counter
+#define JAC_BAL_CHUNKS     8
+#define JAC_BAL_MIN_CHUNK  4096
+
+// the counters, one per thread for each of two iterations, are
+// kept a cache line apart
+#define JAC_BAL_PAD        16
+#define JAC_BAL_NEXT(bl,it,t) \
+        ((bl)->next[(((it)%2)*(bl)->nth + (t))*JAC_BAL_PAD])
+
+typedef struct {
+   int     nth;        // threads it was made for
+   int     nchunks;
+   int    *lo, *hi;    // chunk c is rows lo[c] to hi[c]-1 ...
+   size_t *k0, *k1;    // ... which are nonzeros k0[c] to k1[c]-1
+   int    *head;       // -1, or for a piece of a long row, the
+                       // chunk holding the row's first piece
+   int    *npieces;    // at a head: how many pieces the row has,
+   int    *left;       // and how many are still to be done
+   TYPE   *psum;       // each piece's part of its row's sum
+   int    *first;      // thread t owns chunks first[t] to
+                       // first[t+1]-1
+   int    *next;       // next chunk to take from each thread
+} jac_balance;
+
+// Cut the rows of A (row_start, Ndim+1 of them) into chunks for nth
+// threads.  Returns NULL if memory could not be allocated.
+jac_balance *jac_balance_create(int Ndim, const size_t *row_start, int nth);
+
+void jac_balance_destroy(jac_balance *bl);
+
+// Set the counters for iteration it to the start of each thread's
+// chunks
+void jac_balance_reset(jac_balance *bl, int it);
+
+#endif
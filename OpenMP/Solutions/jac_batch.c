@@ -0,0 +1,288 @@
+//
+// Batched Jacobi solver for many small systems.  See jac_batch.h.
+//
+// Each pack of JAC_BATCH_LANES systems is solved start to finish by
+// one thread, so the pack (16 KB of A for n = 16) stays in L1 or L2
+// for all its sweeps and the threads never meet inside a solve.
+// Every inner loop runs over the lanes with a fixed trip count, so
+// it turns into one or two vector instructions and needs no
+// remainder code.
+//
+// The sweep is compiled once per instruction set, as in jac_simd.c,
+// and the path is picked with jac_simd_select() so both agree on
+// what the CPU can run.
+//
+#include <omp.h>
+#include <math.h>
+#include <string.h>
+#include "jac_batch.h"
+#include "jac_simd.h"
+
+#define L JAC_BATCH_LANES
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JAC_BATCH_X86 1
+#define JAC_BATCH_INLINE static inline __attribute__((always_inline))
+#else
+#define JAC_BATCH_INLINE static inline
+#endif
+
+// packs handed out at a time; packs differ in how many sweeps they
+// take, so they are dealt dynamically
+#define JAC_BATCH_CHUNK 8
+
+typedef void (*batch_pack_fn)(int n, const TYPE *A, const TYPE *b,
+                              const TYPE *dinv, TYPE *x, TYPE *xw,
+                              TYPE tol2, int max_iters, int *iters);
+
+jac_batch *jac_batch_create(int n, int nsys)
+{
+   int  p, i, l;
+   size_t nv;
+   jac_batch *bt = (jac_batch *) malloc(sizeof(jac_batch));
+   if (!bt) return NULL;
+
+   bt->n         = n;
+   bt->nsys      = nsys;
+   bt->npacks    = (nsys + L - 1)/L;
+   bt->tolerance = (TYPE) JAC_BATCH_TOLERANCE;
+   bt->max_iters = JAC_BATCH_MAX_ITERS;
+   bt->simd_path = NULL;
+   bt->max_taken = 0;
+   bt->path      = NULL;
+   bt->elapsed_time = 0.0;
+
+   // b, x, xw and dinv go in one block per pack.  As separate
+   // arrays they would all be huge page aligned, and the same
+   // element of each would land in the same cache set.
+   nv = (size_t)bt->npacks*n*L;
+   bt->A     = (TYPE *) mm_malloc(nv*n*sizeof(TYPE));
+   bt->v     = (TYPE *) mm_malloc(nv*JAC_BATCH_NVEC*sizeof(TYPE));
+   bt->iters = (int *) malloc((size_t)bt->npacks*L*sizeof(int));
+
+   if (!bt->A || !bt->v || !bt->iters){
+      jac_batch_destroy(bt);
+      return NULL;
+   }
+   bt->b    = bt->v;
+   bt->x    = bt->v + (size_t)n*L;
+   bt->xw   = bt->v + (size_t)2*n*L;
+   bt->dinv = bt->v + (size_t)3*n*L;
+
+   // first touch by the thread that will solve each pack
+   #pragma omp parallel for private(i, l) schedule(dynamic, JAC_BATCH_CHUNK)
+   for (p=0; p<bt->npacks; p++){
+      TYPE *a = bt->A + (size_t)p*n*n*L;
+      memset(a, 0, (size_t)n*n*L*sizeof(TYPE));
+      for (i=0; i<n; i++)
+         for (l=0; l<L; l++)
+            a[((size_t)i*n + i)*L + l] = (TYPE) 1.0;
+      memset(bt->v + (size_t)p*JAC_BATCH_NVEC*n*L, 0,
+             (size_t)JAC_BATCH_NVEC*n*L*sizeof(TYPE));
+   }
+   return bt;
+}
+
+void jac_batch_destroy(jac_batch *bt)
+{
+   if (!bt) return;
+   if (bt->A)    mm_free(bt->A);
+   if (bt->v)    mm_free(bt->v);
+   free(bt->iters);
+   free(bt);
+}
+
+void jac_batch_set_matrix(jac_batch *bt, int k, const TYPE *A)
+{
+   int  i, j, n = bt->n;
+   TYPE *a = bt->A + (size_t)(k/L)*n*n*L + k%L;
+
+   for (i=0; i<n; i++)
+      for (j=0; j<n; j++)
+         a[((size_t)j*n + i)*L] = A[i*n + j];
+}
+
+static void batch_put(const jac_batch *bt, TYPE *v, int k, const TYPE *u)
+{
+   int  i, n = bt->n;
+   TYPE *vk = v + (size_t)(k/L)*JAC_BATCH_NVEC*n*L + k%L;
+   for (i=0; i<n; i++) vk[i*L] = u[i];
+}
+
+void jac_batch_set_rhs(jac_batch *bt, int k, const TYPE *b)
+{
+   batch_put(bt, bt->b, k, b);
+}
+
+void jac_batch_set_x(jac_batch *bt, int k, const TYPE *x)
+{
+   batch_put(bt, bt->x, k, x);
+}
+
+void jac_batch_get_x(const jac_batch *bt, int k, TYPE *x)
+{
+   int  i, n = bt->n;
+   const TYPE *xk = bt->x + (size_t)(k/L)*JAC_BATCH_NVEC*n*L + k%L;
+   for (i=0; i<n; i++) x[i] = xk[i*L];
+}
+
+//
+// Solve one pack.  A lane that has converged keeps its x (and so
+// its answer and iteration count match a solve of that system on
+// its own) while the others carry on.
+//
+JAC_BATCH_INLINE void batch_pack(int n, const TYPE *A, const TYPE *b,
+                                 const TYPE *dinv, TYPE *x, TYPE *xw,
+                                 TYPE tol2, int max_iters, int *iters)
+{
+   int  i, j, l, it, active;
+   const TYPE *a;
+   TYPE *xold = x, *xnew = xw, *xt;
+   TYPE conv[L], tmp;
+   int  done[L];
+
+   for (l=0; l<L; l++) done[l] = 0;
+
+   for (it=1; it<=max_iters; it++){
+      for (l=0; l<L; l++) conv[l] = (TYPE) 0.0;
+
+      // xnew collects the off-diagonal sums.  Column j of every row
+      // is added in turn, so no sum waits on the one before it, each
+      // update is one vector across the lanes and A is read in the
+      // order it is stored.
+      memset(xnew, 0, (size_t)n*L*sizeof(TYPE));
+      for (j=0; j<n; j++){
+         for (i=0; i<n; i++){
+            if (i == j) continue;
+            a = A + ((size_t)j*n + i)*L;
+            #pragma omp simd
+            for (l=0; l<L; l++)
+               xnew[i*L+l] += a[l]*xold[j*L+l];
+         }
+      }
+      for (i=0; i<n; i++){
+         #pragma omp simd private(tmp)
+         for (l=0; l<L; l++){
+            tmp = done[l] ? xold[i*L+l] : (b[i*L+l] - xnew[i*L+l])*dinv[i*L+l];
+            xnew[i*L+l] = tmp;
+            tmp -= xold[i*L+l];
+            conv[l] += tmp*tmp;
+         }
+      }
+      xt = xold; xold = xnew; xnew = xt;
+
+      active = 0;
+      for (l=0; l<L; l++){
+         if (done[l]) continue;
+         if (conv[l] <= tol2 || it == max_iters) done[l] = it;
+         else active = 1;
+      }
+      if (!active) break;
+   }
+
+   // the answer is in xold
+   if (xold != x) memcpy(x, xold, (size_t)n*L*sizeof(TYPE));
+   for (l=0; l<L; l++) iters[l] = done[l];
+}
+
+static void batch_pack_scalar(int n, const TYPE *A, const TYPE *b,
+                              const TYPE *dinv, TYPE *x, TYPE *xw,
+                              TYPE tol2, int max_iters, int *iters)
+{
+   batch_pack(n, A, b, dinv, x, xw, tol2, max_iters, iters);
+}
+
+#ifdef JAC_BATCH_X86
+__attribute__((target("sse2")))
+static void batch_pack_sse2(int n, const TYPE *A, const TYPE *b,
+                            const TYPE *dinv, TYPE *x, TYPE *xw,
+                            TYPE tol2, int max_iters, int *iters)
+{
+   batch_pack(n, A, b, dinv, x, xw, tol2, max_iters, iters);
+}
+
+__attribute__((target("avx2,fma")))
+static void batch_pack_avx2(int n, const TYPE *A, const TYPE *b,
+                            const TYPE *dinv, TYPE *x, TYPE *xw,
+                            TYPE tol2, int max_iters, int *iters)
+{
+   batch_pack(n, A, b, dinv, x, xw, tol2, max_iters, iters);
+}
+
+__attribute__((target("avx512f")))
+static void batch_pack_avx512(int n, const TYPE *A, const TYPE *b,
+                              const TYPE *dinv, TYPE *x, TYPE *xw,
+                              TYPE tol2, int max_iters, int *iters)
+{
+   batch_pack(n, A, b, dinv, x, xw, tol2, max_iters, iters);
+}
+#endif
+
+static batch_pack_fn batch_select(const char *name, const char **path)
+{
+   const jac_simd_kernels *k = jac_simd_select(name);
+
+   if (!k) return NULL;
+   *path = k->name;
+#ifdef JAC_BATCH_X86
+   if (!strcmp(k->name, "sse2"))   return batch_pack_sse2;
+   if (!strcmp(k->name, "avx2"))   return batch_pack_avx2;
+   if (!strcmp(k->name, "avx512")) return batch_pack_avx512;
+#endif
+   return batch_pack_scalar;
+}
+
+int jac_batch_solve(jac_batch *bt)
+{
+   int  p, n = bt->n, taken = 0;
+   TYPE tol2 = bt->tolerance*bt->tolerance;
+   batch_pack_fn pack = batch_select(bt->simd_path, &bt->path);
+   double start;
+
+   if (!pack){
+      printf("\n jac_batch_solve: simd path %s is not available\n",
+             bt->simd_path);
+      return -1;
+   }
+
+   start = omp_get_wtime();
+
+   #pragma omp parallel for reduction(max:taken) schedule(dynamic, JAC_BATCH_CHUNK)
+   for (p=0; p<bt->npacks; p++){
+      size_t  off = (size_t)p*JAC_BATCH_NVEC*n*L;
+      const TYPE *A = bt->A + (size_t)p*n*n*L;
+      TYPE   *dinv = bt->dinv + off;
+      int     i, l;
+
+      for (i=0; i<n; i++)
+         for (l=0; l<L; l++)
+            dinv[i*L+l] = (TYPE) 1.0/A[((size_t)i*n + i)*L + l];
+
+      pack(n, A, bt->b + off, dinv, bt->x + off, bt->xw + off,
+           tol2, bt->max_iters, bt->iters + (size_t)p*L);
+      for (l=0; l<L; l++)
+         if (bt->iters[(size_t)p*L + l] > taken)
+            taken = bt->iters[(size_t)p*L + l];
+   }
+
+   bt->elapsed_time = omp_get_wtime() - start;
+   bt->max_taken = taken;
+   return 0;
+}
+
+TYPE jac_batch_residual(const jac_batch *bt, int k)
+{
+   int  i, j, n = bt->n;
+   const TYPE *a = bt->A + (size_t)(k/L)*n*n*L + k%L;
+   const TYPE *b = bt->b + (size_t)(k/L)*JAC_BATCH_NVEC*n*L + k%L;
+   const TYPE *x = bt->x + (size_t)(k/L)*JAC_BATCH_NVEC*n*L + k%L;
+   TYPE ax, err = (TYPE) 0.0;
+
+   for (i=0; i<n; i++){
+      ax = (TYPE) 0.0;
+      for (j=0; j<n; j++)
+         ax += a[((size_t)j*n + i)*L]*x[j*L];
+      err += (ax - b[i*L])*(ax - b[i*L]);
+   }
+   return (TYPE) sqrt((double)err);
+}
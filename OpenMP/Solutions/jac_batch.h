@@ -0,0 +1,84 @@
+//
+// A batched Jacobi solver for many small independent systems, each
+// of order 4 to 64 or so.  One system is too small to split across
+// threads or even to fill a vector register along a row, so the
+// systems are stored structure-of-arrays in packs of
+// JAC_BATCH_LANES: element (i,j) of the systems in a pack sits in
+// consecutive memory and every vector instruction works on one
+// element of JAC_BATCH_LANES systems.  Threads take whole packs.
+//
+// Typical use:
+//
+//    jac_batch *bt = jac_batch_create(n, nsys);
+//    for (each system k){
+//        jac_batch_set_matrix(bt, k, A);   // A[n][n], row major
+//        jac_batch_set_rhs(bt, k, b);
+//    }
+//    jac_batch_solve(bt);                  // x starts at zero
+//    jac_batch_get_x(bt, k, x);
+//    jac_batch_destroy(bt);
+//
+#ifndef JAC_BATCH_H
+#define JAC_BATCH_H
+
+#include "mm_utils.h"
+
+#define JAC_BATCH_TOLERANCE 0.001
+#define JAC_BATCH_MAX_ITERS 5000
+
+// systems per pack: one 64 byte cache line of doubles
+#define JAC_BATCH_LANES 8
+
+// vectors kept per pack: b, x, a work vector and 1/A[i][i]
+#define JAC_BATCH_NVEC  4
+
+typedef struct {
+   int          n;             // order of each system
+   int          nsys;          // number of systems
+   int          npacks;        // packs of JAC_BATCH_LANES systems
+   TYPE         tolerance;     // each system stops when its
+   int          max_iters;     // ||xnew-xold|| <= tolerance
+   const char  *simd_path;     // sweep to use (scalar, sse2, avx2 or
+                               // avx512), NULL for the best one
+
+   // element (i,j) of system k is A[((p*n + j)*n + i)*L + l] (each
+   // pack is stored by columns, the order the sweep reads it) and
+   // element i of its b or x is b[(p*JAC_BATCH_NVEC*n + i)*L + l],
+   // where p = k/L, l = k%L and L = JAC_BATCH_LANES.  The lanes past
+   // nsys in the last pack hold the identity.
+   TYPE        *A;
+   TYPE        *v;             // the vectors, pack by pack
+   TYPE        *b;             // first pack's b, x, ... within v
+   TYPE        *x;             // initial guess in, solution out
+   TYPE        *xw;            // work vector
+   TYPE        *dinv;          // 1/A[i][i], set by jac_batch_solve()
+
+   // results from the last call to jac_batch_solve()
+   int         *iters;         // iterations taken by each system
+   int          max_taken;     // the largest of them
+   const char  *path;          // sweep that was used
+   double       elapsed_time;
+} jac_batch;
+
+// Allocate nsys systems of order n, with A set to the identity and
+// b and x to zero.  Returns NULL if memory could not be allocated.
+jac_batch *jac_batch_create(int n, int nsys);
+
+void jac_batch_destroy(jac_batch *bt);
+
+// Copy system k in or out of the packed layout.  A is n by n,
+// row major.
+void jac_batch_set_matrix(jac_batch *bt, int k, const TYPE *A);
+void jac_batch_set_rhs(jac_batch *bt, int k, const TYPE *b);
+void jac_batch_set_x(jac_batch *bt, int k, const TYPE *x);
+void jac_batch_get_x(const jac_batch *bt, int k, TYPE *x);
+
+// Solve every system, with the packs shared out over the OpenMP
+// threads.  Returns 0, or -1 if simd_path names a sweep this CPU
+// can't run.
+int jac_batch_solve(jac_batch *bt);
+
+// Return ||Ax-b|| for system k
+TYPE jac_batch_residual(const jac_batch *bt, int k);
+
+#endif
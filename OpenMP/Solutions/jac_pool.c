@@ -0,0 +1,209 @@
+//
+// Persistent thread pool for the Jacobi solver.  See jac_pool.h.
+//
+// Between jobs the workers sleep on a condition variable, so an
+// idle pool costs nothing.  Inside a job they only meet at the
+// barrier, which is a counter plus a shared sense flag: each thread
+// flips its own sense, adds itself to the counter and spins until
+// the shared sense matches.  The last thread to arrive resets the
+// counter, does the reduction and flips the shared sense, which
+// releases the others.  Spinning threads yield the CPU after a
+// while (at once if there are more threads than CPUs) so an
+// oversubscribed pool still makes progress.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include "jac_pool.h"
+
+#define JAC_POOL_LINE  64       // keep per-thread data on its own cache line
+#define JAC_POOL_SPINS 4000     // spins before yielding the CPU
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JAC_POOL_PAUSE() __builtin_ia32_pause()
+#else
+#define JAC_POOL_PAUSE()
+#endif
+
+typedef union {
+   struct {
+      double val;               // this thread's part of the sum
+      int    sense;             // this thread's barrier sense
+   } t;
+   char pad[JAC_POOL_LINE];
+} jac_pool_slot;
+
+struct jac_pool {
+   int            nthreads;
+   int            spins;        // spins before yielding the CPU
+   pthread_t     *threads;
+   jac_pool_slot *slots;
+
+   // barrier
+   int            count __attribute__((aligned(JAC_POOL_LINE)));
+   int            sense __attribute__((aligned(JAC_POOL_LINE)));
+   double         sum;
+
+   // job hand off
+   pthread_mutex_t lock;
+   pthread_cond_t  wake;
+   unsigned        job;         // bumped for each new job
+   int             quit;
+   jac_pool_fn     fn;
+   void           *arg;
+};
+
+typedef struct {
+   jac_pool *p;
+   int       tid;
+} jac_pool_start;
+
+static void jac_pool_wait(const jac_pool *p, const int *flag, int value)
+{
+   int spins = 0;
+   while (__atomic_load_n(flag, __ATOMIC_ACQUIRE) != value){
+      if (++spins < p->spins)
+         JAC_POOL_PAUSE();
+      else {
+         sched_yield();
+         spins = 0;
+      }
+   }
+}
+
+double jac_pool_barrier_sum(jac_pool *p, int tid, double val)
+{
+   int i, my_sense = !p->slots[tid].t.sense;
+   double sum;
+
+   p->slots[tid].t.sense = my_sense;
+   p->slots[tid].t.val   = val;
+   if (__atomic_add_fetch(&p->count, 1, __ATOMIC_ACQ_REL) == p->nthreads){
+      // last to arrive: everyone's val is visible through the counter
+      sum = 0.0;
+      for (i=0; i<p->nthreads; i++)
+         sum += p->slots[i].t.val;
+      p->sum   = sum;
+      p->count = 0;
+      __atomic_store_n(&p->sense, my_sense, __ATOMIC_RELEASE);
+   }
+   else
+      jac_pool_wait(p, &p->sense, my_sense);
+
+   // p->sum is not written again until every thread has arrived at
+   // the next barrier, so it is safe to read here
+   return p->sum;
+}
+
+void jac_pool_barrier(jac_pool *p, int tid)
+{
+   jac_pool_barrier_sum(p, tid, 0.0);
+}
+
+static void *jac_pool_worker(void *arg)
+{
+   jac_pool_start *start = (jac_pool_start *) arg;
+   jac_pool *p = start->p;
+   int tid = start->tid;
+   unsigned seen = 0;
+   jac_pool_fn fn;
+   void *fn_arg;
+
+   free(start);
+   for (;;){
+      pthread_mutex_lock(&p->lock);
+      while (p->job == seen && !p->quit)
+         pthread_cond_wait(&p->wake, &p->lock);
+      if (p->quit){
+         pthread_mutex_unlock(&p->lock);
+         break;
+      }
+      seen   = p->job;
+      fn     = p->fn;
+      fn_arg = p->arg;
+      pthread_mutex_unlock(&p->lock);
+
+      fn(fn_arg, tid, p->nthreads);
+      jac_pool_barrier(p, tid);
+   }
+   return NULL;
+}
+
+jac_pool *jac_pool_create(int nthreads)
+{
+   int i;
+   jac_pool_start *start;
+   jac_pool *p;
+
+   if (nthreads < 1) nthreads = 1;
+   p = (jac_pool *) calloc(1, sizeof(jac_pool));
+   if (!p) return NULL;
+   p->nthreads = nthreads;
+   p->spins    = JAC_POOL_SPINS;
+   if (nthreads > sysconf(_SC_NPROCESSORS_ONLN)) p->spins = 0;
+   p->threads  = (pthread_t *) malloc(nthreads*sizeof(pthread_t));
+   p->slots    = (jac_pool_slot *) calloc(nthreads, sizeof(jac_pool_slot));
+   if (!p->threads || !p->slots){
+      free(p->threads);
+      free(p->slots);
+      free(p);
+      return NULL;
+   }
+   pthread_mutex_init(&p->lock, NULL);
+   pthread_cond_init(&p->wake, NULL);
+
+   // thread 0 is whoever calls jac_pool_run()
+   for (i=1; i<nthreads; i++){
+      start = (jac_pool_start *) malloc(sizeof(jac_pool_start));
+      if (start){
+         start->p   = p;
+         start->tid = i;
+      }
+      if (!start || pthread_create(&p->threads[i], NULL, jac_pool_worker, start)){
+         printf("\n jac_pool_create: could not start thread %d\n", i);
+         free(start);
+         p->nthreads = i;
+         jac_pool_destroy(p);
+         return NULL;
+      }
+   }
+   return p;
+}
+
+void jac_pool_destroy(jac_pool *p)
+{
+   int i;
+   if (!p) return;
+   pthread_mutex_lock(&p->lock);
+   p->quit = 1;
+   pthread_cond_broadcast(&p->wake);
+   pthread_mutex_unlock(&p->lock);
+   for (i=1; i<p->nthreads; i++)
+      pthread_join(p->threads[i], NULL);
+
+   pthread_mutex_destroy(&p->lock);
+   pthread_cond_destroy(&p->wake);
+   free(p->threads);
+   free(p->slots);
+   free(p);
+}
+
+int jac_pool_size(const jac_pool *p)
+{
+   return p->nthreads;
+}
+
+void jac_pool_run(jac_pool *p, jac_pool_fn fn, void *arg)
+{
+   pthread_mutex_lock(&p->lock);
+   p->fn  = fn;
+   p->arg = arg;
+   p->job++;
+   pthread_cond_broadcast(&p->wake);
+   pthread_mutex_unlock(&p->lock);
+
+   fn(arg, 0, p->nthreads);
+   jac_pool_barrier(p, 0);
+}
@@ -0,0 +1,37 @@
+//
+// A pool of long lived worker threads for the Jacobi solver.  The
+// threads are started once and reused for every solve, and within
+// a solve they synchronize with a spinning sense-reversing barrier
+// instead of the fork/join and implicit barriers of OpenMP.  The
+// barrier can also sum one value from each thread, so a sweep plus
+// the convergence test costs a single barrier.
+//
+#ifndef JAC_POOL_H
+#define JAC_POOL_H
+
+typedef struct jac_pool jac_pool;
+
+// work run by every thread of the pool; tid runs from 0 to
+// nthreads-1 and the calling thread is tid 0
+typedef void (*jac_pool_fn)(void *arg, int tid, int nthreads);
+
+// Start a pool of nthreads threads (counting the caller).  Returns
+// NULL if the threads could not be created.
+jac_pool *jac_pool_create(int nthreads);
+
+void jac_pool_destroy(jac_pool *p);
+
+int jac_pool_size(const jac_pool *p);
+
+// Run fn on all the threads and return when they have all finished
+void jac_pool_run(jac_pool *p, jac_pool_fn fn, void *arg);
+
+// Wait until all threads reach the barrier
+void jac_pool_barrier(jac_pool *p, int tid);
+
+// Barrier that also returns, on every thread, the sum of val over
+// the threads.  The sum is taken in thread order, so it is the same
+// from run to run.
+double jac_pool_barrier_sum(jac_pool *p, int tid, double val);
+
+#endif
@@ -0,0 +1,355 @@
+//
+// Reverse Cuthill-McKee reordering.  See jac_rcm.h.
+//
+// The ordering is the usual one: start each connected piece of the
+// graph from a pseudo-peripheral node (found by repeated breadth
+// first searches, after George and Liu), number the nodes level by
+// level with the unnumbered neighbours of each node taken in order
+// of increasing degree, and reverse the result.
+//
+#include <omp.h>
+#include <string.h>
+#include "jac_rcm.h"
+
+// breadth first searches tried when looking for a peripheral node
+#define RCM_MAX_TRIES 8
+
+// (degree, node) in one key, so sorting keys sorts nodes by degree
+// with ties broken by node number
+#define RCM_KEY(deg,node) (((long long)(deg) << 32) | (long long)(node))
+#define RCM_NODE(key)     ((int)((key) & 0xFFFFFFFFLL))
+
+// the symmetric graph of A, without the diagonal: the neighbours of
+// node i are adj[start[i]] to adj[start[i]+deg[i]-1]
+typedef struct {
+   size_t  *start;
+   int     *deg;
+   int     *adj;
+} rcm_graph;
+
+static int cmp_int(const void *a, const void *b)
+{
+   int x = *(const int *) a, y = *(const int *) b;
+   return (x > y) - (x < y);
+}
+
+// sort a node's list; most are short, and insertion sort beats
+// qsort's calls through a function pointer there
+static void sort_ints(int *a, int n)
+{
+   int i, j, t;
+
+   if (n > 32){
+      qsort(a, n, sizeof(int), cmp_int);
+      return;
+   }
+   for (i=1; i<n; i++){
+      t = a[i];
+      for (j=i; j>0 && a[j-1] > t; j--) a[j] = a[j-1];
+      a[j] = t;
+   }
+}
+
+static int cmp_key(const void *a, const void *b)
+{
+   long long x = *(const long long *) a, y = *(const long long *) b;
+   return (x > y) - (x < y);
+}
+
+static void rcm_graph_free(rcm_graph *g)
+{
+   mm_free(g->start);
+   mm_free(g->deg);
+   mm_free(g->adj);
+}
+
+//
+// Every off-diagonal nonzero A[i][j] makes i and j neighbours.  Row
+// i of A goes straight into node i's list, followed by the column i
+// entries of the other rows.  Those land anywhere, so their slots
+// are handed out with an atomic counter per node first and written
+// in a second pass: with the random stores in the same loop every
+// locked add would wait for them.  Then each list is sorted and the
+// edges that A has both ways round are merged.
+//
+static int rcm_graph_build(int Ndim, const size_t *row_start,
+                           const int *col, rcm_graph *g)
+{
+   int  i, j, n, d, q;
+   size_t k, p, nnz = row_start[Ndim];
+   int  *rev, *pos;
+
+   g->start = (size_t *) mm_malloc((size_t)(Ndim+1)*sizeof(size_t));
+   g->deg   = (int *) mm_malloc(Ndim*sizeof(int));
+   g->adj   = NULL;
+   rev      = (int *) mm_malloc(Ndim*sizeof(int));
+   pos      = (int *) mm_malloc((nnz > 0 ? nnz : 1)*sizeof(int));
+   if (!g->start || !g->deg || !rev || !pos){
+      rcm_graph_free(g);
+      mm_free(rev);
+      mm_free(pos);
+      return -1;
+   }
+
+   // deg counts row i's own entries, rev the ones in column i
+   #pragma omp parallel for schedule(static)
+   for (i=0; i<Ndim; i++) rev[i] = 0;
+
+   #pragma omp parallel for private(k, j, n) schedule(static)
+   for (i=0; i<Ndim; i++){
+      for (n=0, k=row_start[i]; k<row_start[i+1]; k++){
+         j = col[k];
+         if (j == i) continue;
+         n++;
+         #pragma omp atomic
+         rev[j]++;
+      }
+      g->deg[i] = n;
+   }
+
+   g->start[0] = 0;
+   for (i=0; i<Ndim; i++)
+      g->start[i+1] = g->start[i] + g->deg[i] + rev[i];
+   g->adj = (int *) mm_malloc((g->start[Ndim] > 0 ? g->start[Ndim] : 1)
+                              *sizeof(int));
+   if (!g->adj){
+      rcm_graph_free(g);
+      mm_free(rev);
+      mm_free(pos);
+      return -1;
+   }
+
+   #pragma omp parallel for schedule(static)
+   for (i=0; i<Ndim; i++) rev[i] = 0;
+
+   #pragma omp parallel for private(k, j, p, q) schedule(static)
+   for (i=0; i<Ndim; i++)
+      for (p=g->start[i], k=row_start[i]; k<row_start[i+1]; k++){
+         j = col[k];
+         if (j == i) continue;
+         g->adj[p++] = j;
+         #pragma omp atomic capture
+         q = rev[j]++;
+         pos[k] = q;
+      }
+
+   #pragma omp parallel for private(k, j) schedule(static)
+   for (i=0; i<Ndim; i++)
+      for (k=row_start[i]; k<row_start[i+1]; k++){
+         j = col[k];
+         if (j != i) g->adj[g->start[j] + g->deg[j] + pos[k]] = i;
+      }
+
+   #pragma omp parallel for private(k, d, n) schedule(dynamic, 256)
+   for (i=0; i<Ndim; i++){
+      int *a = g->adj + g->start[i];
+      n = g->deg[i] + rev[i];
+      sort_ints(a, n);
+      for (d=0, k=0; k<(size_t)n; k++)
+         if (k == 0 || a[k] != a[k-1]) a[d++] = a[k];
+      g->deg[i] = d;
+   }
+   mm_free(rev);
+   mm_free(pos);
+   return 0;
+}
+
+//
+// Breadth first search from root.  Returns the number of levels,
+// with the nodes reached in queue[0] to queue[*size-1] and the last
+// level starting at queue[*first].  mark is all zero on entry and
+// on return.
+//
+static int rcm_levels(const rcm_graph *g, int root, char *mark, int *queue,
+                      int *first, int *size)
+{
+   int  head = 0, tail = 0, level_end, nlev = 0, u, v, q;
+   size_t k;
+
+   queue[tail++] = root;
+   mark[root] = 1;
+   *first = 0;
+   while (head < tail){
+      *first = head;
+      level_end = tail;
+      nlev++;
+      for (; head<level_end; head++){
+         u = queue[head];
+         for (k=g->start[u]; k<g->start[u]+g->deg[u]; k++){
+            v = g->adj[k];
+            if (!mark[v]){
+               mark[v] = 1;
+               queue[tail++] = v;
+            }
+         }
+      }
+   }
+   for (q=0; q<tail; q++) mark[queue[q]] = 0;
+   *size = tail;
+   return nlev;
+}
+
+// A node at the far edge of the piece of the graph holding seed
+static int rcm_peripheral(const rcm_graph *g, int seed, char *mark,
+                          int *queue)
+{
+   int  root = seed, x, q, t, nlev, n2, first, size;
+
+   nlev = rcm_levels(g, root, mark, queue, &first, &size);
+   for (t=0; t<RCM_MAX_TRIES; t++){
+      // the lowest degree node of the last level
+      x = queue[first];
+      for (q=first+1; q<size; q++)
+         if (g->deg[queue[q]] < g->deg[x]) x = queue[q];
+      n2 = rcm_levels(g, x, mark, queue, &first, &size);
+      if (n2 <= nlev) break;
+      root = x;
+      nlev = n2;
+   }
+   return root;
+}
+
+int jac_rcm(int Ndim, const size_t *row_start, const int *col, int *perm)
+{
+   int  i, u, v, q, t, head = 0, tail = 0, nk, maxdeg = 0, root;
+   size_t k;
+   rcm_graph g;
+   char *mark, *numbered;
+   int  *queue;
+   long long *seeds, *keys;
+
+   if (rcm_graph_build(Ndim, row_start, col, &g)) return -1;
+   for (i=0; i<Ndim; i++)
+      if (g.deg[i] > maxdeg) maxdeg = g.deg[i];
+
+   mark     = (char *) mm_malloc(Ndim);
+   numbered = (char *) mm_malloc(Ndim);
+   queue    = (int *) mm_malloc(Ndim*sizeof(int));
+   seeds    = (long long *) mm_malloc(Ndim*sizeof(long long));
+   keys     = (long long *) mm_malloc((maxdeg+1)*sizeof(long long));
+   if (!mark || !numbered || !queue || !seeds || !keys){
+      mm_free(mark); mm_free(numbered); mm_free(queue); mm_free(seeds);
+      mm_free(keys);
+      rcm_graph_free(&g);
+      return -1;
+   }
+   memset(mark, 0, Ndim);
+   memset(numbered, 0, Ndim);
+
+   // each new piece of the graph starts near its lowest degree node
+   for (i=0; i<Ndim; i++) seeds[i] = RCM_KEY(g.deg[i], i);
+   qsort(seeds, Ndim, sizeof(long long), cmp_key);
+
+   // Cuthill-McKee order, built up in perm
+   for (t=0; t<Ndim; t++){
+      if (numbered[RCM_NODE(seeds[t])]) continue;
+      root = rcm_peripheral(&g, RCM_NODE(seeds[t]), mark, queue);
+      perm[tail++] = root;
+      numbered[root] = 1;
+      while (head < tail){
+         u = perm[head++];
+         for (nk=0, k=g.start[u]; k<g.start[u]+g.deg[u]; k++){
+            v = g.adj[k];
+            if (!numbered[v]){
+               numbered[v] = 1;
+               keys[nk++] = RCM_KEY(g.deg[v], v);
+            }
+         }
+         qsort(keys, nk, sizeof(long long), cmp_key);
+         for (q=0; q<nk; q++) perm[tail++] = RCM_NODE(keys[q]);
+      }
+   }
+
+   // and reversed
+   for (i=0; i<Ndim/2; i++){
+      u = perm[i];
+      perm[i] = perm[Ndim-1-i];
+      perm[Ndim-1-i] = u;
+   }
+
+   mm_free(mark); mm_free(numbered); mm_free(queue); mm_free(seeds);
+   mm_free(keys);
+   rcm_graph_free(&g);
+   return 0;
+}
+
+// sort a row's columns, carrying the values along (rows are short,
+// so a shell sort does)
+static void sort_pairs(int *c, TYPE *v, size_t n)
+{
+   size_t gap, i, j;
+   int  ct;
+   TYPE vt;
+
+   for (gap=n/2; gap>0; gap/=2)
+      for (i=gap; i<n; i++){
+         ct = c[i];
+         vt = v[i];
+         for (j=i; j>=gap && c[j-gap] > ct; j-=gap){
+            c[j] = c[j-gap];
+            v[j] = v[j-gap];
+         }
+         c[j] = ct;
+         v[j] = vt;
+      }
+}
+
+int jac_csr_permute(int Ndim, const int *perm, size_t *row_start,
+                    int *col, TYPE *val)
+{
+   int  i;
+   size_t k, p, nnz = row_start[Ndim];
+   int  *iperm = (int *) mm_malloc(Ndim*sizeof(int));
+   size_t *nstart = (size_t *) mm_malloc((size_t)(Ndim+1)*sizeof(size_t));
+   int  *ncol = (int *) mm_malloc(nnz*sizeof(int));
+   TYPE *nval = (TYPE *) mm_malloc(nnz*sizeof(TYPE));
+
+   if (!iperm || !nstart || !ncol || !nval){
+      mm_free(iperm); mm_free(nstart); mm_free(ncol); mm_free(nval);
+      return -1;
+   }
+
+   #pragma omp parallel for schedule(static)
+   for (i=0; i<Ndim; i++) iperm[perm[i]] = i;
+
+   nstart[0] = 0;
+   for (i=0; i<Ndim; i++)
+      nstart[i+1] = nstart[i] + (row_start[perm[i]+1] - row_start[perm[i]]);
+
+   #pragma omp parallel for private(k, p) schedule(static)
+   for (i=0; i<Ndim; i++){
+      for (p=nstart[i], k=row_start[perm[i]]; k<row_start[perm[i]+1]; k++, p++){
+         ncol[p] = iperm[col[k]];
+         nval[p] = val[k];
+      }
+      sort_pairs(ncol+nstart[i], nval+nstart[i], nstart[i+1]-nstart[i]);
+   }
+
+   // back into A's arrays, each thread copying the rows it sweeps
+   #pragma omp parallel for schedule(static)
+   for (i=0; i<Ndim; i++){
+      row_start[i] = nstart[i];
+      memcpy(col+nstart[i], ncol+nstart[i],
+             (nstart[i+1]-nstart[i])*sizeof(int));
+      memcpy(val+nstart[i], nval+nstart[i],
+             (nstart[i+1]-nstart[i])*sizeof(TYPE));
+   }
+   row_start[Ndim] = nstart[Ndim];
+
+   mm_free(iperm); mm_free(nstart); mm_free(ncol); mm_free(nval);
+   return 0;
+}
+
+int jac_csr_bandwidth(int Ndim, const size_t *row_start, const int *col)
+{
+   int  i, d, bw = 0;
+   size_t k;
+
+   #pragma omp parallel for private(k, d) reduction(max:bw) schedule(static)
+   for (i=0; i<Ndim; i++)
+      for (k=row_start[i]; k<row_start[i+1]; k++){
+         d = (col[k] > i) ? col[k]-i : i-col[k];
+         if (d > bw) bw = d;
+      }
+   return bw;
+}
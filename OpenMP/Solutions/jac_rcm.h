@@ -0,0 +1,32 @@
+//
+// Reverse Cuthill-McKee reordering for sparse matrices in CSR form
+// (see init_sparse_near_identity_matrix in mm_utils.h).  Numbering
+// the unknowns in breadth first order from a node at the edge of
+// the graph of A keeps each row's nonzeros near its diagonal, so the
+// xold a sweep gathers for nearby rows sits in the same cache lines.
+//
+// A matrix whose nonzero pattern isn't symmetric is ordered by the
+// pattern of A + A^T.  Building the graph, sorting its rows and
+// permuting A run in parallel; the breadth first search is serial.
+//
+#ifndef JAC_RCM_H
+#define JAC_RCM_H
+
+#include "mm_utils.h"
+
+// Work out the RCM ordering of A: on return row i of the reordered
+// matrix is row perm[i] of A.  Returns 0, or -1 if memory could not
+// be allocated.
+int jac_rcm(int Ndim, const size_t *row_start, const int *col, int *perm);
+
+// Reorder the rows and columns of A in place with the same
+// permutation (row i of the result is row perm[i] of A), keeping
+// the columns of each row in increasing order.  Returns 0, or -1 if
+// memory could not be allocated.
+int jac_csr_permute(int Ndim, const int *perm, size_t *row_start,
+                    int *col, TYPE *val);
+
+// The largest |i-j| over the nonzeros A[i][j]
+int jac_csr_bandwidth(int Ndim, const size_t *row_start, const int *col);
+
+#endif
@@ -0,0 +1,645 @@
+//
+// Hand vectorized kernels for the Jacobi solver.  See jac_simd.h.
+//
+// The SSE2, AVX2 and AVX-512 versions are compiled with per-function
+// target attributes, so the file builds with the usual -O3 flags and
+// the CPU is checked (with cpuid, through __builtin_cpu_supports) only
+// when a path is selected.  They are written for TYPE double; with
+// any other TYPE only the scalar path is available.
+//
+#include <string.h>
+#include "jac_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define JAC_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+//=========================================================
+// Scalar
+//=========================================================
+static TYPE dot_scalar(int n, const TYPE *a, const TYPE *x)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   for (j=0; j<n; j++)
+      sum += a[j]*x[j];
+   return sum;
+}
+
+static TYPE sqdiff_scalar(int n, const TYPE *x, const TYPE *y)
+{
+   int j;
+   TYPE tmp, sum = (TYPE) 0.0;
+   for (j=0; j<n; j++){
+      tmp  = x[j]-y[j];
+      sum += tmp*tmp;
+   }
+   return sum;
+}
+
+static TYPE dot_mixed_scalar(int n, const float *a, const TYPE *x)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   for (j=0; j<n; j++)
+      sum += (TYPE) a[j]*x[j];
+   return sum;
+}
+
+static TYPE dot_q8_scalar(int n, const signed char *q, const TYPE *x)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   for (j=0; j<n; j++)
+      sum += (TYPE) q[j]*x[j];
+   return sum;
+}
+
+static TYPE dot_q16_scalar(int n, const short *q, const TYPE *x)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   for (j=0; j<n; j++)
+      sum += (TYPE) q[j]*x[j];
+   return sum;
+}
+
+static void mac_scalar(int n, const TYPE *a, const TYPE *x, TYPE *y)
+{
+   int j;
+   for (j=0; j<n; j++)
+      y[j] += a[j]*x[j];
+}
+
+static TYPE dot_gather_scalar(int n, const TYPE *a, const int *col,
+                              const TYPE *x)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   for (j=0; j<n; j++)
+      sum += a[j]*x[col[j]];
+   return sum;
+}
+
+static TYPE dot_hash_scalar(int n, unsigned key, const TYPE *x)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   for (j=0; j<n; j++)
+      sum += (TYPE) MM_HASH_ELEM(key, j)*x[j];
+   return sum;
+}
+
+static const jac_simd_kernels scalar_kernels = {
+   "scalar", dot_scalar, sqdiff_scalar, dot_mixed_scalar,
+   dot_q8_scalar, dot_q16_scalar, mac_scalar, dot_gather_scalar,
+   dot_hash_scalar
+};
+
+#ifdef JAC_SIMD_X86
+//=========================================================
+// SSE2: two doubles per register, two accumulators
+//=========================================================
+__attribute__((target("sse2")))
+static TYPE dot_sse2(int n, const TYPE *a, const TYPE *x)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+   double  t[2], sum;
+   int     j = 0;
+
+   for (; j+4<=n; j+=4){
+      s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_loadu_pd(pa+j),   _mm_loadu_pd(px+j)));
+      s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_loadu_pd(pa+j+2), _mm_loadu_pd(px+j+2)));
+   }
+   _mm_storeu_pd(t, _mm_add_pd(s0, s1));
+   sum = t[0] + t[1];
+   for (; j<n; j++)
+      sum += pa[j]*px[j];
+   return (TYPE) sum;
+}
+
+__attribute__((target("sse2")))
+static TYPE sqdiff_sse2(int n, const TYPE *x, const TYPE *y)
+{
+   const double *px = (const double *) x, *py = (const double *) y;
+   __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd(), d0, d1;
+   double  t[2], sum, tmp;
+   int     j = 0;
+
+   for (; j+4<=n; j+=4){
+      d0 = _mm_sub_pd(_mm_loadu_pd(px+j),   _mm_loadu_pd(py+j));
+      d1 = _mm_sub_pd(_mm_loadu_pd(px+j+2), _mm_loadu_pd(py+j+2));
+      s0 = _mm_add_pd(s0, _mm_mul_pd(d0, d0));
+      s1 = _mm_add_pd(s1, _mm_mul_pd(d1, d1));
+   }
+   _mm_storeu_pd(t, _mm_add_pd(s0, s1));
+   sum = t[0] + t[1];
+   for (; j<n; j++){
+      tmp  = px[j]-py[j];
+      sum += tmp*tmp;
+   }
+   return (TYPE) sum;
+}
+
+__attribute__((target("sse2")))
+static void mac_sse2(int n, const TYPE *a, const TYPE *x, TYPE *y)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   double *py = (double *) y;
+   int     j = 0;
+
+   for (; j+4<=n; j+=4){
+      _mm_storeu_pd(py+j,   _mm_add_pd(_mm_loadu_pd(py+j),
+                          _mm_mul_pd(_mm_loadu_pd(pa+j),   _mm_loadu_pd(px+j))));
+      _mm_storeu_pd(py+j+2, _mm_add_pd(_mm_loadu_pd(py+j+2),
+                          _mm_mul_pd(_mm_loadu_pd(pa+j+2), _mm_loadu_pd(px+j+2))));
+   }
+   for (; j<n; j++)
+      py[j] += pa[j]*px[j];
+}
+
+__attribute__((target("sse2")))
+static TYPE dot_mixed_sse2(int n, const float *a, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m128d s0 = _mm_setzero_pd(), s1 = _mm_setzero_pd();
+   __m128  af;
+   double  t[2], sum;
+   int     j = 0;
+
+   for (; j+4<=n; j+=4){
+      af = _mm_loadu_ps(a+j);
+      s0 = _mm_add_pd(s0, _mm_mul_pd(_mm_cvtps_pd(af), _mm_loadu_pd(px+j)));
+      s1 = _mm_add_pd(s1, _mm_mul_pd(_mm_cvtps_pd(_mm_movehl_ps(af, af)),
+                                     _mm_loadu_pd(px+j+2)));
+   }
+   _mm_storeu_pd(t, _mm_add_pd(s0, s1));
+   sum = t[0] + t[1];
+   for (; j<n; j++)
+      sum += (double) a[j]*px[j];
+   return (TYPE) sum;
+}
+
+//=========================================================
+// AVX2 + FMA: four doubles per register, four accumulators
+//=========================================================
+__attribute__((target("avx2,fma")))
+static double hsum_avx(__m256d v)
+{
+   __m128d lo = _mm256_castpd256_pd128(v), hi = _mm256_extractf128_pd(v, 1);
+   lo = _mm_add_pd(lo, hi);
+   return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo)));
+}
+
+__attribute__((target("avx2,fma")))
+static TYPE dot_avx2(int n, const TYPE *a, const TYPE *x)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+   __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+16<=n; j+=16){
+      s0 = _mm256_fmadd_pd(_mm256_loadu_pd(pa+j),    _mm256_loadu_pd(px+j),    s0);
+      s1 = _mm256_fmadd_pd(_mm256_loadu_pd(pa+j+4),  _mm256_loadu_pd(px+j+4),  s1);
+      s2 = _mm256_fmadd_pd(_mm256_loadu_pd(pa+j+8),  _mm256_loadu_pd(px+j+8),  s2);
+      s3 = _mm256_fmadd_pd(_mm256_loadu_pd(pa+j+12), _mm256_loadu_pd(px+j+12), s3);
+   }
+   for (; j+4<=n; j+=4)
+      s0 = _mm256_fmadd_pd(_mm256_loadu_pd(pa+j), _mm256_loadu_pd(px+j), s0);
+   sum = hsum_avx(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+   for (; j<n; j++)
+      sum += pa[j]*px[j];
+   return (TYPE) sum;
+}
+
+__attribute__((target("avx2,fma")))
+static TYPE dot_mixed_avx2(int n, const float *a, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+   __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+16<=n; j+=16){
+      s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a+j)),    _mm256_loadu_pd(px+j),    s0);
+      s1 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a+j+4)),  _mm256_loadu_pd(px+j+4),  s1);
+      s2 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a+j+8)),  _mm256_loadu_pd(px+j+8),  s2);
+      s3 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a+j+12)), _mm256_loadu_pd(px+j+12), s3);
+   }
+   for (; j+4<=n; j+=4)
+      s0 = _mm256_fmadd_pd(_mm256_cvtps_pd(_mm_loadu_ps(a+j)), _mm256_loadu_pd(px+j), s0);
+   sum = hsum_avx(_mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3)));
+   for (; j<n; j++)
+      sum += (double) a[j]*px[j];
+   return (TYPE) sum;
+}
+
+// sign extend 4 integers to 32 bits (SSE4.1, which AVX2 includes)
+// and widen them to doubles
+__attribute__((target("avx2,fma")))
+static TYPE dot_q8_avx2(int n, const signed char *q, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+   __m128i v;
+   double  sum;
+   int     j = 0, w;
+
+   for (; j+8<=n; j+=8){
+      memcpy(&w, q+j, 4);
+      v  = _mm_cvtepi8_epi32(_mm_cvtsi32_si128(w));
+      s0 = _mm256_fmadd_pd(_mm256_cvtepi32_pd(v), _mm256_loadu_pd(px+j), s0);
+      memcpy(&w, q+j+4, 4);
+      v  = _mm_cvtepi8_epi32(_mm_cvtsi32_si128(w));
+      s1 = _mm256_fmadd_pd(_mm256_cvtepi32_pd(v), _mm256_loadu_pd(px+j+4), s1);
+   }
+   sum = hsum_avx(_mm256_add_pd(s0, s1));
+   for (; j<n; j++)
+      sum += (double) q[j]*px[j];
+   return (TYPE) sum;
+}
+
+__attribute__((target("avx2,fma")))
+static TYPE dot_q16_avx2(int n, const short *q, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+   __m128i v;
+   double  sum;
+   int     j = 0;
+
+   for (; j+8<=n; j+=8){
+      v  = _mm_loadu_si128((const __m128i *)(q+j));
+      s0 = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm_cvtepi16_epi32(v)),
+                           _mm256_loadu_pd(px+j), s0);
+      s1 = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm_cvtepi16_epi32(
+                              _mm_unpackhi_epi64(v, v))),
+                           _mm256_loadu_pd(px+j+4), s1);
+   }
+   sum = hsum_avx(_mm256_add_pd(s0, s1));
+   for (; j<n; j++)
+      sum += (double) q[j]*px[j];
+   return (TYPE) sum;
+}
+
+__attribute__((target("avx2,fma")))
+static TYPE sqdiff_avx2(int n, const TYPE *x, const TYPE *y)
+{
+   const double *px = (const double *) x, *py = (const double *) y;
+   __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd(), d0, d1;
+   double  sum, tmp;
+   int     j = 0;
+
+   for (; j+8<=n; j+=8){
+      d0 = _mm256_sub_pd(_mm256_loadu_pd(px+j),   _mm256_loadu_pd(py+j));
+      d1 = _mm256_sub_pd(_mm256_loadu_pd(px+j+4), _mm256_loadu_pd(py+j+4));
+      s0 = _mm256_fmadd_pd(d0, d0, s0);
+      s1 = _mm256_fmadd_pd(d1, d1, s1);
+   }
+   sum = hsum_avx(_mm256_add_pd(s0, s1));
+   for (; j<n; j++){
+      tmp  = px[j]-py[j];
+      sum += tmp*tmp;
+   }
+   return (TYPE) sum;
+}
+
+__attribute__((target("avx2,fma")))
+static void mac_avx2(int n, const TYPE *a, const TYPE *x, TYPE *y)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   double *py = (double *) y;
+   int     j = 0;
+
+   for (; j+8<=n; j+=8){
+      _mm256_storeu_pd(py+j,   _mm256_fmadd_pd(_mm256_loadu_pd(pa+j),
+                          _mm256_loadu_pd(px+j),   _mm256_loadu_pd(py+j)));
+      _mm256_storeu_pd(py+j+4, _mm256_fmadd_pd(_mm256_loadu_pd(pa+j+4),
+                          _mm256_loadu_pd(px+j+4), _mm256_loadu_pd(py+j+4)));
+   }
+   for (; j<n; j++)
+      py[j] += pa[j]*px[j];
+}
+
+__attribute__((target("avx2,fma")))
+static TYPE dot_gather_avx2(int n, const TYPE *a, const int *col,
+                            const TYPE *x)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   __m256d s0 = _mm256_setzero_pd();
+   __m256d all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+   double  sum;
+   int     j = 0;
+
+   // the masked gathers, as the plain ones set off
+   // -Wmaybe-uninitialized in some GCC versions
+   for (; j+4<=n; j+=4)
+      s0 = _mm256_fmadd_pd(_mm256_loadu_pd(pa+j),
+              _mm256_mask_i32gather_pd(_mm256_setzero_pd(), px,
+                 _mm_loadu_si128((const __m128i *)(col+j)), all, 8), s0);
+   sum = hsum_avx(s0);
+   for (; j<n; j++)
+      sum += pa[j]*px[col[j]];
+   return (TYPE) sum;
+}
+
+// MM_HASH_ELEM for eight columns at once
+__attribute__((target("avx2,fma")))
+static __m256i hash_elem_avx2(__m256i x)
+{
+   x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+   x = _mm256_mullo_epi32(x, _mm256_set1_epi32(0x7feb352d));
+   x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 15));
+   x = _mm256_mullo_epi32(x, _mm256_set1_epi32((int) 0x846ca68bU));
+   x = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+   return _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_srli_epi32(x, 8),
+                                               _mm256_set1_epi32(23)), 24);
+}
+
+__attribute__((target("avx2,fma")))
+static TYPE dot_hash_avx2(int n, unsigned key, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m256i jv = _mm256_add_epi32(_mm256_set1_epi32((int) key),
+                                 _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+   __m256i r;
+   __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+8<=n; j+=8){
+      r  = hash_elem_avx2(jv);
+      s0 = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(r)),
+                           _mm256_loadu_pd(px+j), s0);
+      s1 = _mm256_fmadd_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(r, 1)),
+                           _mm256_loadu_pd(px+j+4), s1);
+      jv = _mm256_add_epi32(jv, _mm256_set1_epi32(8));
+   }
+   sum = hsum_avx(_mm256_add_pd(s0, s1));
+   for (; j<n; j++)
+      sum += MM_HASH_ELEM(key, j)*px[j];
+   return (TYPE) sum;
+}
+
+//=========================================================
+// AVX-512: eight doubles per register, masked remainder
+//=========================================================
+__attribute__((target("avx512f")))
+static double hsum_avx512(__m512d v)
+{
+   double t[8];
+   _mm512_storeu_pd(t, v);
+   return ((t[0]+t[4]) + (t[1]+t[5])) + ((t[2]+t[6]) + (t[3]+t[7]));
+}
+
+__attribute__((target("avx512f")))
+static TYPE dot_avx512(int n, const TYPE *a, const TYPE *x)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+   __mmask8 m;
+   int     j = 0;
+
+   for (; j+16<=n; j+=16){
+      s0 = _mm512_fmadd_pd(_mm512_loadu_pd(pa+j),   _mm512_loadu_pd(px+j),   s0);
+      s1 = _mm512_fmadd_pd(_mm512_loadu_pd(pa+j+8), _mm512_loadu_pd(px+j+8), s1);
+   }
+   for (; j<n; j+=8){
+      m  = (n-j >= 8) ? (__mmask8) 0xFF : (__mmask8) ((1u << (n-j)) - 1);
+      s0 = _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, pa+j),
+                           _mm512_maskz_loadu_pd(m, px+j), s0);
+   }
+   return (TYPE) hsum_avx512(_mm512_add_pd(s0, s1));
+}
+
+// float to double with a full mask: the unmasked _mm512_cvtps_pd
+// sets off -Wmaybe-uninitialized in some GCC versions
+#define CVT8(p) _mm512_maskz_cvtps_pd((__mmask8) 0xFF, _mm256_loadu_ps(p))
+
+__attribute__((target("avx512f")))
+static TYPE dot_mixed_avx512(int n, const float *a, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+16<=n; j+=16){
+      s0 = _mm512_fmadd_pd(CVT8(a+j),   _mm512_loadu_pd(px+j),   s0);
+      s1 = _mm512_fmadd_pd(CVT8(a+j+8), _mm512_loadu_pd(px+j+8), s1);
+   }
+   for (; j+8<=n; j+=8)
+      s0 = _mm512_fmadd_pd(CVT8(a+j), _mm512_loadu_pd(px+j), s0);
+   sum = hsum_avx512(_mm512_add_pd(s0, s1));
+   for (; j<n; j++)
+      sum += (double) a[j]*px[j];
+   return (TYPE) sum;
+}
+
+// 8 integers sign extended to 32 bits, then to doubles
+#define Q8TOPD(p)  _mm512_maskz_cvtepi32_pd((__mmask8) 0xFF, \
+                      _mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)(p))))
+#define Q16TOPD(p) _mm512_maskz_cvtepi32_pd((__mmask8) 0xFF, \
+                      _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(p))))
+
+__attribute__((target("avx512f")))
+static TYPE dot_q8_avx512(int n, const signed char *q, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+16<=n; j+=16){
+      s0 = _mm512_fmadd_pd(Q8TOPD(q+j),   _mm512_loadu_pd(px+j),   s0);
+      s1 = _mm512_fmadd_pd(Q8TOPD(q+j+8), _mm512_loadu_pd(px+j+8), s1);
+   }
+   for (; j+8<=n; j+=8)
+      s0 = _mm512_fmadd_pd(Q8TOPD(q+j), _mm512_loadu_pd(px+j), s0);
+   sum = hsum_avx512(_mm512_add_pd(s0, s1));
+   for (; j<n; j++)
+      sum += (double) q[j]*px[j];
+   return (TYPE) sum;
+}
+
+__attribute__((target("avx512f")))
+static TYPE dot_q16_avx512(int n, const short *q, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+16<=n; j+=16){
+      s0 = _mm512_fmadd_pd(Q16TOPD(q+j),   _mm512_loadu_pd(px+j),   s0);
+      s1 = _mm512_fmadd_pd(Q16TOPD(q+j+8), _mm512_loadu_pd(px+j+8), s1);
+   }
+   for (; j+8<=n; j+=8)
+      s0 = _mm512_fmadd_pd(Q16TOPD(q+j), _mm512_loadu_pd(px+j), s0);
+   sum = hsum_avx512(_mm512_add_pd(s0, s1));
+   for (; j<n; j++)
+      sum += (double) q[j]*px[j];
+   return (TYPE) sum;
+}
+
+__attribute__((target("avx512f")))
+static TYPE sqdiff_avx512(int n, const TYPE *x, const TYPE *y)
+{
+   const double *px = (const double *) x, *py = (const double *) y;
+   __m512d s0 = _mm512_setzero_pd(), d0;
+   __mmask8 m;
+   int     j = 0;
+
+   for (; j+8<=n; j+=8){
+      d0 = _mm512_sub_pd(_mm512_loadu_pd(px+j), _mm512_loadu_pd(py+j));
+      s0 = _mm512_fmadd_pd(d0, d0, s0);
+   }
+   if (j<n){
+      m  = (__mmask8) ((1u << (n-j)) - 1);
+      d0 = _mm512_sub_pd(_mm512_maskz_loadu_pd(m, px+j),
+                         _mm512_maskz_loadu_pd(m, py+j));
+      s0 = _mm512_fmadd_pd(d0, d0, s0);
+   }
+   return (TYPE) hsum_avx512(s0);
+}
+
+__attribute__((target("avx512f")))
+static void mac_avx512(int n, const TYPE *a, const TYPE *x, TYPE *y)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   double *py = (double *) y;
+   __mmask8 m;
+   int     j = 0;
+
+   for (; j+8<=n; j+=8)
+      _mm512_storeu_pd(py+j, _mm512_fmadd_pd(_mm512_loadu_pd(pa+j),
+                          _mm512_loadu_pd(px+j), _mm512_loadu_pd(py+j)));
+   if (j<n){
+      m = (__mmask8) ((1u << (n-j)) - 1);
+      _mm512_mask_storeu_pd(py+j, m,
+            _mm512_fmadd_pd(_mm512_maskz_loadu_pd(m, pa+j),
+                            _mm512_maskz_loadu_pd(m, px+j),
+                            _mm512_maskz_loadu_pd(m, py+j)));
+   }
+}
+
+// the remainder is done one at a time, since a masked load of the
+// column numbers needs AVX512VL; the gather has a full mask for the
+// same reason as CVT8
+__attribute__((target("avx512f")))
+static TYPE dot_gather_avx512(int n, const TYPE *a, const int *col,
+                              const TYPE *x)
+{
+   const double *pa = (const double *) a, *px = (const double *) x;
+   __m512d s0 = _mm512_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+8<=n; j+=8)
+      s0 = _mm512_fmadd_pd(_mm512_loadu_pd(pa+j),
+              _mm512_mask_i32gather_pd(_mm512_setzero_pd(), (__mmask8) 0xFF,
+                 _mm256_loadu_si256((const __m256i *)(col+j)), px, 8), s0);
+   sum = hsum_avx512(s0);
+   for (; j<n; j++)
+      sum += pa[j]*px[col[j]];
+   return (TYPE) sum;
+}
+
+// MM_HASH_ELEM for sixteen columns at once.  The masked shifts and
+// extracts, as the plain ones set off -Wmaybe-uninitialized too.
+#define SRL32(x,n) _mm512_maskz_srli_epi32((__mmask16) 0xFFFF, x, n)
+#define HALF(r,h)  _mm512_maskz_cvtepi32_pd((__mmask8) 0xFF, \
+                      _mm512_maskz_extracti64x4_epi64((__mmask8) 0xF, r, h))
+
+__attribute__((target("avx512f")))
+static __m512i hash_elem_avx512(__m512i x)
+{
+   x = _mm512_xor_si512(x, SRL32(x, 16));
+   x = _mm512_mullo_epi32(x, _mm512_set1_epi32(0x7feb352d));
+   x = _mm512_xor_si512(x, SRL32(x, 15));
+   x = _mm512_mullo_epi32(x, _mm512_set1_epi32((int) 0x846ca68bU));
+   x = _mm512_xor_si512(x, SRL32(x, 16));
+   return SRL32(_mm512_mullo_epi32(SRL32(x, 8), _mm512_set1_epi32(23)), 24);
+}
+
+__attribute__((target("avx512f")))
+static TYPE dot_hash_avx512(int n, unsigned key, const TYPE *x)
+{
+   const double *px = (const double *) x;
+   __m512i jv = _mm512_add_epi32(_mm512_set1_epi32((int) key),
+                   _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7,
+                                     8, 9, 10, 11, 12, 13, 14, 15));
+   __m512i r;
+   __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+   double  sum;
+   int     j = 0;
+
+   for (; j+16<=n; j+=16){
+      r  = hash_elem_avx512(jv);
+      s0 = _mm512_fmadd_pd(HALF(r, 0), _mm512_loadu_pd(px+j), s0);
+      s1 = _mm512_fmadd_pd(HALF(r, 1), _mm512_loadu_pd(px+j+8), s1);
+      jv = _mm512_add_epi32(jv, _mm512_set1_epi32(16));
+   }
+   sum = hsum_avx512(_mm512_add_pd(s0, s1));
+   for (; j<n; j++)
+      sum += MM_HASH_ELEM(key, j)*px[j];
+   return (TYPE) sum;
+}
+
+// SSE2 has no sign extending loads (they came with SSE4.1), so its
+// quantized dots are the scalar ones, no gathers, so its CSR dot
+// is too, and no 32 bit multiply, so its hashed dot is as well
+static const jac_simd_kernels sse2_kernels = {
+   "sse2", dot_sse2, sqdiff_sse2, dot_mixed_sse2,
+   dot_q8_scalar, dot_q16_scalar, mac_sse2, dot_gather_scalar,
+   dot_hash_scalar
+};
+static const jac_simd_kernels avx2_kernels = {
+   "avx2", dot_avx2, sqdiff_avx2, dot_mixed_avx2,
+   dot_q8_avx2, dot_q16_avx2, mac_avx2, dot_gather_avx2,
+   dot_hash_avx2
+};
+static const jac_simd_kernels avx512_kernels = {
+   "avx512", dot_avx512, sqdiff_avx512, dot_mixed_avx512,
+   dot_q8_avx512, dot_q16_avx512, mac_avx512, dot_gather_avx512,
+   dot_hash_avx512
+};
+#endif
+
+const jac_simd_kernels *jac_simd_scalar(void)
+{
+   return &scalar_kernels;
+}
+
+const jac_simd_kernels *jac_simd_select(const char *name)
+{
+#ifdef JAC_SIMD_X86
+   const jac_simd_kernels *best = &scalar_kernels;
+   int sse2 = 0, avx2 = 0, avx512 = 0;
+
+   if (sizeof(TYPE) == sizeof(double)){
+      __builtin_cpu_init();
+      sse2   = __builtin_cpu_supports("sse2");
+      avx2   = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+      avx512 = __builtin_cpu_supports("avx512f");
+   }
+   if (sse2)   best = &sse2_kernels;
+   if (avx2)   best = &avx2_kernels;
+   if (avx512) best = &avx512_kernels;
+
+   if (!name)                   return best;
+   if (!strcmp(name, "scalar")) return &scalar_kernels;
+   if (!strcmp(name, "sse2"))   return sse2   ? &sse2_kernels   : NULL;
+   if (!strcmp(name, "avx2"))   return avx2   ? &avx2_kernels   : NULL;
+   if (!strcmp(name, "avx512")) return avx512 ? &avx512_kernels : NULL;
+   return NULL;
+#else
+   if (!name || !strcmp(name, "scalar")) return &scalar_kernels;
+   return NULL;
+#endif
+}
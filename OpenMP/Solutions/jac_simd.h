@@ -0,0 +1,48 @@
+//
+// Hand vectorized kernels for the Jacobi solver.  The instruction
+// set is picked at run time from what the CPU supports, so one
+// binary runs the best path on every node it lands on.
+//
+#ifndef JAC_SIMD_H
+#define JAC_SIMD_H
+
+#include "mm_utils.h"
+
+typedef struct {
+   const char *name;
+
+   // sum of a[j]*x[j] for j = 0 to n-1
+   TYPE (*dot)(int n, const TYPE *a, const TYPE *x);
+
+   // sum of (x[j]-y[j])^2 for j = 0 to n-1
+   TYPE (*sqdiff)(int n, const TYPE *x, const TYPE *y);
+
+   // dot with a stored in float, each a[j] widened to TYPE before
+   // the multiply so only the storage is single precision
+   TYPE (*dot_mixed)(int n, const float *a, const TYPE *x);
+
+   // dot with a quantized to 8 or 16 bit integers; the caller
+   // multiplies by the scale of the row
+   TYPE (*dot_q8)(int n, const signed char *q, const TYPE *x);
+   TYPE (*dot_q16)(int n, const short *q, const TYPE *x);
+
+   // y[j] += a[j]*x[j] for j = 0 to n-1 (one diagonal of a banded A)
+   void (*mac)(int n, const TYPE *a, const TYPE *x, TYPE *y);
+
+   // sum of a[j]*x[col[j]] for j = 0 to n-1 (one row of a CSR A)
+   TYPE (*dot_gather)(int n, const TYPE *a, const int *col, const TYPE *x);
+
+   // sum of MM_HASH_ELEM(key,j)*x[j] for j = 0 to n-1 (one row of a
+   // matrix-free A, before it is scaled)
+   TYPE (*dot_hash)(int n, unsigned key, const TYPE *x);
+} jac_simd_kernels;
+
+// Plain C versions of the kernels
+const jac_simd_kernels *jac_simd_scalar(void);
+
+// Return the kernels for the named path (scalar, sse2, avx2 or
+// avx512), or the widest one this CPU supports if name is NULL.
+// Returns NULL if the named path is unknown or not supported.
+const jac_simd_kernels *jac_simd_select(const char *name);
+
+#endif
@@ -0,0 +1,123 @@
+/*
+**  PROGRAM: jacobi Solver ... many small systems at once
+**
+**  PURPOSE: Solve a batch of small independent systems with the
+**           batched solver in jac_batch.c and report how many
+**           systems per second it gets through.
+**
+**  USAGE:   ./jac_solv_batch [-s path] [-r repeats] [n] [nsys]
+**
+**              n         order of each system (default 16)
+**              nsys      number of systems (default 100000)
+**              -s path   scalar, sse2, avx2 or avx512 (default is the
+**                        best the CPU supports)
+**              -r n      solve the batch n times
+**
+**  HISTORY: Written by Tim Mattson, Oct 2015
+*/
+
+#include<omp.h>
+#include<math.h>
+#include<string.h>
+#include "jac_batch.h"
+
+#define DEF_ORDER 16
+#define DEF_NSYS  100000
+
+static void usage(const char *prog)
+{
+   printf(" usage: %s [-s scalar|sse2|avx2|avx512] [-r repeats] [n] [nsys]\n",
+          prog);
+   exit(-1);
+}
+
+int main(int argc, char **argv)
+{
+   int  n = DEF_ORDER, nsys = DEF_NSYS, repeats = 1, npos = 0;
+   int  i, j, k, r, min_it, max_it;
+   const char *simd_path = NULL;
+   TYPE *A, *b, *x, err, max_err, chksum, off;
+   jac_batch *bt;
+
+   for (i=1; i<argc; i++){
+      if (!strcmp(argv[i], "-s") && i+1<argc)
+         simd_path = argv[++i];
+      else if (!strcmp(argv[i], "-r") && i+1<argc)
+         repeats = atoi(argv[++i]);
+      else if (argv[i][0] != '-' && npos == 0)
+         { n = atoi(argv[i]); npos++; }
+      else if (argv[i][0] != '-' && npos == 1)
+         { nsys = atoi(argv[i]); npos++; }
+      else
+         usage(argv[0]);
+   }
+   if (n < 1 || nsys < 1) usage(argv[0]);
+
+   printf(" \n\n batched jacobi solver: %d systems of order %d\n", nsys, n);
+
+   bt = jac_batch_create(n, nsys);
+   A  = (TYPE *) malloc((size_t)n*n*sizeof(TYPE));
+   b  = (TYPE *) malloc(n*sizeof(TYPE));
+   x  = (TYPE *) malloc(n*sizeof(TYPE));
+
+   if (!bt || !A || !b || !x)
+   {
+        printf("\n memory allocation error\n");
+        exit(-1);
+   }
+   bt->simd_path = simd_path;
+   mm_alloc_report("A", bt->A);
+
+   // a different diagonally dominant matrix for every system.  For
+   // small n the generator now and then makes a row that is all
+   // zeros (NaN once scaled) or only just dominant, and Jacobi
+   // doesn't converge, so draw those matrices again.
+   for (k=0; k<nsys; k++){
+      do {
+         init_diag_dom_near_identity_matrix(n, A);
+         for (i=0; i<n; i++){
+            for (off=(TYPE)0.0, j=0; j<n; j++)
+               if (j != i) off += A[i*n+j];
+            if (!(A[i*n+i] > off + (TYPE)0.01)) break;
+         }
+      } while (i < n);
+      jac_batch_set_matrix(bt, k, A);
+   }
+
+   for (r=0; r<repeats; r++){
+      for (k=0; k<nsys; k++){
+         for (i=0; i<n; i++){
+            b[i] = (TYPE)(rand()%51)/100.0;
+            x[i] = (TYPE)0.0;
+         }
+         jac_batch_set_rhs(bt, k, b);
+         jac_batch_set_x(bt, k, x);
+      }
+
+      if (jac_batch_solve(bt)) exit(-1);
+
+      min_it = max_it = bt->iters[0];
+      max_err = chksum = (TYPE) 0.0;
+      for (k=0; k<nsys; k++){
+         if (bt->iters[k] < min_it) min_it = bt->iters[k];
+         if (bt->iters[k] > max_it) max_it = bt->iters[k];
+         err = jac_batch_residual(bt, k);
+         if (err > max_err) max_err = err;
+         jac_batch_get_x(bt, k, x);
+         for (i=0; i<n; i++) chksum += x[i];
+      }
+      printf(" %s path: %d to %d iterations, %f seconds, %g systems/s\n",
+             bt->path, min_it, max_it, (float)bt->elapsed_time,
+             nsys/bt->elapsed_time);
+      printf("jacobi solver: max err = %f, sum of checksums = %f \n",
+             (float)max_err, (float)chksum);
+      if (max_err > JAC_BATCH_TOLERANCE)
+         printf("\nWARNING: final solution error > %g\n\n",
+                JAC_BATCH_TOLERANCE);
+   }
+
+   jac_batch_destroy(bt);
+   free(A);
+   free(b);
+   free(x);
+}
@@ -0,0 +1,524 @@
+/*
+**  PROGRAM: jacobi Solver ... driver for the reentrant solver library
+**
+**  PURPOSE: This program runs the same problem as jac_solv.c but
+**           calls the solver in jac_solver.c, so the matrix is
+**           allocated and set up once and can be solved repeatedly.
+**
+**  USAGE:   Run wtihout arguments to use default SIZE.
+**
+**              ./jac_solv_lib
+**
+**           Run with a single argument for the order of the A
+**           matrix ... for example
+**
+**              ./jac_solv_lib 2500
+**
+**           Options (after or before the order of A):
+**
+**              -b name   backend: serial, parfor, region, target, pool
+**                        or task
+**              -r n      solve n times, with a new b each time
+**              -f        fuse the convergence test into the sweep
+**              -c k      test convergence every k iterations
+**                        (0 adapts k to the rate of convergence)
+**              -a n      region backend only: sweep asynchronously,
+**                        with no thread more than n iterations ahead
+**              -o        region backend only: overlap the convergence
+**                        sum with the next sweep
+**              -d        reproducible sums: the same iterations and
+**                        answer for any number of threads
+**              -t        tune threads, schedule and chunk size for
+**                        this host and problem and save them in the
+**                        profile; later runs pick them up from there
+**              -p file   profile file (default $JAC_PROFILE or
+**                        jac_tune.prof)
+**              -m nrhs   solve for nrhs right hand sides at once
+**              -x        mixed precision: sweep with A in float, and
+**                        compare with the all double solve
+**              -q bits   sweep with A quantized to 8 or 16 bits per
+**                        element, and compare with the double solve
+**              -y full   a symmetric positive definite A, stored in
+**              -y packed full or as its upper triangle only
+**              -w bw     a banded A with bw diagonals each side of the
+**                        main one, stored by diagonals, so ndim can
+**                        run to millions
+**              -z nzr    a sparse A with nzr nonzeros in each row,
+**                        stored in CSR form (with -w bw, nonzeros
+**                        within about bw of the diagonal)
+**              -P        with -z: row lengths follow a power law,
+**                        nzr on average, the longest rows first
+**              -l        balance the sparse A's rows over the threads
+**                        by nonzeros, with work stealing
+**              -S        shuffle the unknowns of the sparse A, as
+**                        if it came in no particular order
+**              -R        reorder the sparse A (reverse Cuthill-McKee)
+**                        before solving
+**              -g seed   a matrix-free A: its elements are made from
+**                        a hash of (seed, i, j) in every sweep, so
+**                        nothing of size ndim*ndim is stored
+**              -G seed   the same A, stored in full, for comparison
+**              -T        a Toeplitz A, kept as its 2*ndim-1 diagonals
+**              -C        a circulant A, kept the same way
+**              -K p      a Kronecker product A = B (x) C, B p by p and
+**                        C ndim/p by ndim/p (ndim is rounded down to
+**                        a multiple of p)
+**              -L k      a diagonal plus rank k A, D + U*V^T
+**              -k name   sweep kernel: branchy, split, blocked or simd
+**              -s path   simd path: scalar, sse2, avx2 or avx512
+**                        (default is the best the CPU supports)
+**              -n copies keep this many copies of xold, one per socket
+**                        (use with OMP_PROC_BIND=close)
+**
+**  HISTORY: Written by Tim Mattson, Oct 2015
+*/
+
+#include<omp.h>
+#include<math.h>
+#include<string.h>
+#include "jac_solver.h"
+#include "jac_tune.h"
+#include "jac_rcm.h"
+
+#define DEF_SIZE  1000
+
+static void usage(const char *prog)
+{
+   printf(" usage: %s [-b serial|parfor|region|target|pool|task] [-r repeats] [-f] [-c k] [-a n] [-o] [-d]\n        [-t] [-p profile] [-m nrhs] [-x] [-q 8|16]\n        [-y full|packed] [-w bw] [-z nzr] [-P] [-l] [-S] [-R]\n        [-g seed] [-G seed] [-T] [-C] [-K p] [-L k]\n"
+          "        [-k branchy|split|blocked|simd]\n"
+          "        [-s scalar|sse2|avx2|avx512] [-n copies] [ndim]\n",
+          prog);
+   exit(-1);
+}
+
+//
+// What each thread did in the last banded or CSR solve, and how far
+// the busiest thread was above the average
+//
+static void print_thread_stats(const jac_solver *s)
+{
+   int  t;
+   double max_busy = 0.0, sum_busy = 0.0;
+
+   printf(" thread   elements swept   busy (s)   idle (s)   steals\n");
+   for (t=0; t<s->ntstats; t++){
+      printf(" %6d %16lu %10.4f %10.4f %8d\n", t,
+             (unsigned long)s->tstats[t].work, s->tstats[t].busy,
+             s->tstats[t].idle, s->tstats[t].steals);
+      if (s->tstats[t].busy > max_busy) max_busy = s->tstats[t].busy;
+      sum_busy += s->tstats[t].busy;
+   }
+   if (sum_busy > 0.0)
+      printf(" busiest thread / average = %.2f\n",
+             max_busy*s->ntstats/sum_busy);
+}
+
+//
+// Solve for nrhs right hand sides at once and check every column
+//
+static void run_multi(jac_solver *s, int nrhs, int repeats)
+{
+   int  i, k, r, Ndim = s->Ndim, min_it, max_it;
+   TYPE err, chksum, max_err, sum;
+   TYPE *B = (TYPE *) malloc((size_t)Ndim*nrhs*sizeof(TYPE));
+   TYPE *X = (TYPE *) malloc((size_t)Ndim*nrhs*sizeof(TYPE));
+   TYPE *b = (TYPE *) malloc(Ndim*sizeof(TYPE));
+   TYPE *x = (TYPE *) malloc(Ndim*sizeof(TYPE));
+   int  *iters = (int *) malloc(nrhs*sizeof(int));
+
+   if (!B || !X || !b || !x || !iters)
+   {
+        printf("\n memory allocation error\n");
+        exit(-1);
+   }
+
+   for (r=0; r<repeats; r++){
+      for(i=0; i<Ndim*nrhs; i++){
+        X[i] = (TYPE)0.0;
+        B[i] = (TYPE)(rand()%51)/100.0;
+      }
+
+      if (jac_solve_multi(s, nrhs, B, X, iters) < 0) break;
+      min_it = max_it = iters[0];
+      for (k=1; k<nrhs; k++){
+         if (iters[k] < min_it) min_it = iters[k];
+         if (iters[k] > max_it) max_it = iters[k];
+      }
+      printf(" %d right hand sides: %d to %d iterations and %f seconds\n",
+            nrhs, min_it, max_it, (float)s->elapsed_time);
+
+      max_err = sum = (TYPE)0.0;
+      for (k=0; k<nrhs; k++){
+         for (i=0; i<Ndim; i++){
+            b[i] = B[(size_t)i*nrhs+k];
+            x[i] = X[(size_t)i*nrhs+k];
+         }
+         err = jac_residual(s, b, x, &chksum);
+         if (err > max_err) max_err = err;
+         sum += chksum;
+      }
+      printf("jacobi solver: max err = %f, sum of checksums = %f \n",
+                                  (float)max_err, (float)sum);
+      if (max_err > JAC_TOLERANCE)
+         printf("\nWARNING: final solution error > %g\n\n", JAC_TOLERANCE);
+   }
+   free(B);
+   free(X);
+   free(b);
+   free(x);
+   free(iters);
+}
+
+int main(int argc, char **argv)
+{
+   int Ndim = DEF_SIZE;   // A[Ndim][Ndim]
+   int backend = JAC_PAR_REGION;
+   int repeats = 1;
+   int fused   = 0;
+   int check_every = 1;
+   int async   = 0;
+   int speculate = 0;
+   int deterministic = 0;
+   int tune    = 0;
+   int nrhs    = 0;
+   int mixed   = 0;
+   int quant   = 0;
+   int spd     = 0;       // 1 for an spd A in full, 2 packed
+   int bw      = -1;      // half bandwidth of a banded A
+   int nzr     = 0;       // nonzeros per row of a CSR A
+   int powerlaw = 0;
+   int balance = 0;
+   int shuffle = 0;
+   int reorder = 0;
+   int hashed  = 0;       // 1 for a matrix-free A, 2 the same stored
+   unsigned seed = 0;
+   int structured = 0;    // 1 Toeplitz, 2 circulant, 3 Kronecker,
+                          // 4 diagonal plus low rank
+   int kp      = 0;       // order of B for a Kronecker A
+   int rank    = 0;       // k for a diagonal plus rank k A
+   int *perm;
+   const char *profile = getenv("JAC_PROFILE");
+   double sweep_time;
+   int kernel  = JAC_KERNEL_BRANCHY;
+   const char *simd_path = NULL;
+   int replicas = 1;
+   int i, r;
+   TYPE err, chksum, diff, dmax;
+   TYPE *b, *x, *xd;
+   jac_solver *s;
+
+   for (i=1; i<argc; i++){
+      if (!strcmp(argv[i], "-b") && i+1<argc){
+         backend = jac_backend_from_name(argv[++i]);
+         if (backend < 0) usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-r") && i+1<argc){
+         repeats = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-k") && i+1<argc){
+         kernel = jac_kernel_from_name(argv[++i]);
+         if (kernel < 0) usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-s") && i+1<argc){
+         simd_path = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-n") && i+1<argc){
+         replicas = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-c") && i+1<argc){
+         check_every = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-a") && i+1<argc){
+         async = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-o")){
+         speculate = 1;
+      }
+      else if (!strcmp(argv[i], "-d")){
+         deterministic = 1;
+      }
+      else if (!strcmp(argv[i], "-m") && i+1<argc){
+         nrhs = atoi(argv[++i]);
+      }
+      else if (!strcmp(argv[i], "-x")){
+         mixed = 1;
+      }
+      else if (!strcmp(argv[i], "-y") && i+1<argc){
+         i++;
+         if      (!strcmp(argv[i], "full"))   spd = 1;
+         else if (!strcmp(argv[i], "packed")) spd = 2;
+         else usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-w") && i+1<argc){
+         bw = atoi(argv[++i]);
+         if (bw < 0) usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-z") && i+1<argc){
+         nzr = atoi(argv[++i]);
+         if (nzr < 1) usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-P")){
+         powerlaw = 1;
+      }
+      else if (!strcmp(argv[i], "-l")){
+         balance = 1;
+      }
+      else if ((!strcmp(argv[i], "-g") || !strcmp(argv[i], "-G"))
+               && i+1<argc){
+         hashed = (argv[i][1] == 'g') ? 1 : 2;
+         seed   = (unsigned) strtoul(argv[++i], NULL, 0);
+      }
+      else if (!strcmp(argv[i], "-T")){
+         structured = 1;
+      }
+      else if (!strcmp(argv[i], "-C")){
+         structured = 2;
+      }
+      else if (!strcmp(argv[i], "-K") && i+1<argc){
+         structured = 3;
+         kp = atoi(argv[++i]);
+         if (kp < 1) usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-L") && i+1<argc){
+         structured = 4;
+         rank = atoi(argv[++i]);
+         if (rank < 1 || rank > JAC_MAX_RANK) usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-S")){
+         shuffle = 1;
+      }
+      else if (!strcmp(argv[i], "-R")){
+         reorder = 1;
+      }
+      else if (!strcmp(argv[i], "-q") && i+1<argc){
+         quant = atoi(argv[++i]);
+         if (quant != 8 && quant != 16) usage(argv[0]);
+      }
+      else if (!strcmp(argv[i], "-t")){
+         tune = 1;
+      }
+      else if (!strcmp(argv[i], "-p") && i+1<argc){
+         profile = argv[++i];
+      }
+      else if (!strcmp(argv[i], "-f")){
+         fused = 1;
+      }
+      else if (argv[i][0] != '-'){
+         Ndim = atoi(argv[i]);
+      }
+      else
+         usage(argv[0]);
+   }
+   if ((spd != 0) + (bw >= 0 && nzr == 0) + (nzr > 0) + (hashed != 0)
+       + (structured != 0) > 1)
+      usage(argv[0]);
+   if (structured == 3){
+      if (kp > Ndim) usage(argv[0]);
+      Ndim = kp*(Ndim/kp);
+   }
+   if ((shuffle || reorder || powerlaw || balance) && nzr == 0)
+      usage(argv[0]);
+   if (powerlaw && bw >= 0) usage(argv[0]);
+   if (nzr > Ndim) nzr = Ndim;
+
+   printf(" \n\n jacobi solver library (%s backend, %s kernel%s%s%s): ndim = %d\n",
+          jac_backend_name((jac_backend)backend),
+          jac_kernel_name((jac_kernel)kernel),
+          async ? ", async" : (speculate ? ", speculative" :
+                               (fused ? ", fused" : "")),
+          mixed ? ", float A" : "",
+          quant == 8 ? ", int8 A" : (quant == 16 ? ", int16 A" : ""), Ndim);
+   if (spd)
+      printf(" symmetric positive definite A, %s storage\n",
+             spd == 2 ? "packed" : "full");
+   if (hashed)
+      printf(" A made from hashes of seed %u, %s\n", seed,
+             hashed == 1 ? "matrix-free" : "stored in full");
+   if (nzr > 0)
+      printf(" sparse A in CSR form, %d nonzeros per row%s\n", nzr,
+             powerlaw ? " on average (power law)" : "");
+   if (structured == 1 || structured == 2)
+      printf(" %s A, %d diagonals stored\n",
+             structured == 1 ? "Toeplitz" : "circulant", 2*Ndim-1);
+   if (structured == 3)
+      printf(" Kronecker product A, %d by %d times %d by %d\n",
+             kp, kp, Ndim/kp, Ndim/kp);
+   if (structured == 4)
+      printf(" diagonal plus rank %d A\n", rank);
+
+   if (hashed == 1)
+      s = jac_create_generated(Ndim, seed, (jac_backend)backend);
+   else if (structured == 1 || structured == 2)
+      s = jac_create_toeplitz(Ndim, (jac_backend)backend);
+   else if (structured == 3)
+      s = jac_create_kronecker(kp, Ndim/kp, (jac_backend)backend);
+   else if (structured == 4)
+      s = jac_create_lowrank(Ndim, rank, (jac_backend)backend);
+   else if (powerlaw)
+      s = jac_create_csr(Ndim, mm_powerlaw_nnz(Ndim, nzr),
+                         (jac_backend)backend);
+   else if (nzr > 0)
+      s = jac_create_csr(Ndim, (size_t)Ndim*nzr, (jac_backend)backend);
+   else if (bw >= 0)
+      s = jac_create_banded(Ndim, bw, (jac_backend)backend);
+   else if (spd == 2)
+      s = jac_create_packed(Ndim, (jac_backend)backend);
+   else
+      s = jac_create(Ndim, (jac_backend)backend);
+   b = (TYPE *) malloc(Ndim*sizeof(TYPE));
+   x = (TYPE *) malloc(Ndim*sizeof(TYPE));
+   xd = (TYPE *) malloc(Ndim*sizeof(TYPE));
+
+   if (!s || !b || !x || !xd)
+   {
+        printf("\n memory allocation error\n");
+        exit(-1);
+   }
+   // jac_create_banded keeps the band inside the matrix
+   if (s->storage == JAC_BANDED)
+      printf(" banded A, %d diagonals stored\n", 2*s->bw+1);
+   s->fused  = fused;
+   s->check_every = check_every;
+   s->async  = async;
+   s->speculate = speculate;
+   s->deterministic = deterministic;
+   s->kernel = (jac_kernel)kernel;
+   s->simd_path = simd_path;
+   s->replicas  = replicas;
+   s->mixed     = mixed;
+   s->quant     = quant;
+   s->balance   = balance;
+
+   // generate our diagonally dominant matrix, A
+   if (hashed == 1)
+      ;  // nothing to fill in
+   else if (hashed == 2)
+      init_hashed_diag_dom_matrix(Ndim, seed, s->A);
+   else if (structured == 1)
+      init_toeplitz_matrix(Ndim, s->A);
+   else if (structured == 2)
+      init_circulant_matrix(Ndim, s->A);
+   else if (structured == 3){
+      init_kron_factor(kp, s->A);
+      init_kron_factor(Ndim/kp, s->A + (size_t)kp*kp);
+   }
+   else if (structured == 4)
+      init_lowrank_matrix(Ndim, rank, s->A, s->A + Ndim,
+                          s->A + Ndim + (size_t)Ndim*rank);
+   else if (powerlaw)
+      init_sparse_powerlaw_matrix(Ndim, nzr, s->row_start, s->col, s->A);
+   else if (nzr > 0 && bw >= 0)
+      init_sparse_banded_near_identity_matrix(Ndim, nzr, bw, s->row_start,
+                                              s->col, s->A);
+   else if (nzr > 0)
+      init_sparse_near_identity_matrix(Ndim, nzr, s->row_start, s->col,
+                                       s->A);
+   else if (bw >= 0)
+      init_banded_near_identity_matrix(Ndim, s->bw, s->A);
+   else if (spd == 2)
+      init_spd_packed_matrix(Ndim, s->A);
+   else if (spd == 1)
+      init_spd_matrix(Ndim, s->A);
+   else
+      init_diag_dom_near_identity_matrix(Ndim, s->A);
+   mm_alloc_report("A", s->A);
+   if (shuffle){
+      perm = (int *) malloc(Ndim*sizeof(int));
+      if (!perm){
+           printf("\n memory allocation error\n");
+           exit(-1);
+      }
+      mm_random_permutation(Ndim, perm);
+      jac_csr_permute(Ndim, perm, s->row_start, s->col, s->A);
+      free(perm);
+   }
+   if (nzr > 0)
+      printf(" bandwidth = %d\n",
+             jac_csr_bandwidth(Ndim, s->row_start, s->col));
+   if (reorder && jac_reorder(s) == 0)
+      printf(" reordered in %f seconds, bandwidth now %d\n",
+             (float)s->reorder_time,
+             jac_csr_bandwidth(Ndim, s->row_start, s->col));
+   if (!profile) profile = JAC_PROFILE_FILE;
+   if (!tune && jac_profile_load(s, profile))
+      printf(" from %s: %d threads, schedule(%s,%d)\n", profile,
+             s->nthreads, jac_sched_name(s->sched_kind), s->sched_chunk);
+   jac_setup(s);
+   // -x and -q are for a dense A only and jac_setup drops them for
+   // the rest, so compare with the all double solve only if it kept them
+   mixed = s->mixed;
+   quant = s->quant;
+   printf(" simd path = %s\n", s->simd->name);
+   if (s->xrep) printf(" copies of xold = %d\n", s->replicas);
+
+   if (tune){
+      for(i=0; i<Ndim; i++)
+        b[i] = (TYPE)(rand()%51)/100.0;
+      sweep_time = jac_tune(s, b, 1);
+      printf(" best: %d threads, schedule(%s,%d), %g s/sweep\n",
+             s->nthreads, jac_sched_name(s->sched_kind), s->sched_chunk,
+             sweep_time);
+      if (jac_profile_save(s, profile, sweep_time) == 0)
+         printf(" saved in %s\n", profile);
+   }
+
+   if (nrhs > 0){
+      run_multi(s, nrhs, repeats);
+      repeats = 0;
+   }
+
+   for (r=0; r<repeats; r++){
+      //
+      // Initialize x and just give b some non-zero random values
+      //
+      for(i=0; i<Ndim; i++){
+        x[i] = (TYPE)0.0;
+        b[i] = (TYPE)(rand()%51)/100.0;
+      }
+
+      jac_solve(s, b, x);
+      printf(" Convergence = %g with %d iterations and %f seconds\n",
+            (float)s->conv, s->iters, (float)s->elapsed_time);
+      if (s->checks != s->iters)
+         printf(" convergence tested %d times\n", s->checks);
+
+      err = jac_residual(s, b, x, &chksum);
+      printf("jacobi solver: err = %f, solution checksum = %f \n",
+                                  (float)err, (float)chksum);
+      if (err > JAC_TOLERANCE)
+         printf("\nWARNING: final solution error > %g\n\n", JAC_TOLERANCE);
+      if (s->deterministic)
+         // in full, for comparing runs on different numbers of threads
+         printf(" reproducible: conv = %.17g, checksum = %.17g\n",
+                (double)s->conv, (double)chksum);
+
+      if (mixed || quant){
+         // the same solve all in double, for comparison
+         s->mixed = 0;
+         s->quant = 0;
+         jac_setup(s);
+         memset(xd, 0, Ndim*sizeof(TYPE));
+         jac_solve(s, b, xd);
+         err = jac_residual(s, b, xd, &chksum);
+         for (dmax=(TYPE)0.0, i=0; i<Ndim; i++){
+            diff = (TYPE) fabs((double)(x[i]-xd[i]));
+            if (diff > dmax) dmax = diff;
+         }
+         printf(" all double: %d iterations and %f seconds, err = %f,"
+                " checksum = %f\n", s->iters, (float)s->elapsed_time,
+                (float)err, (float)chksum);
+         printf(" largest difference from the all double x = %g\n",
+                (double)dmax);
+         s->mixed = mixed;
+         s->quant = quant;
+         jac_setup(s);
+      }
+   }
+
+   if (s->ntstats > 0) print_thread_stats(s);
+
+   jac_destroy(s);
+   free(b);
+   free(x);
+   free(xd);
+}
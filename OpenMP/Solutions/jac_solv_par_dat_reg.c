@@ -53,7 +53,8 @@ int main(int argc, char **argv)
    int i,j, iters;
    double start_time, elapsed_time;
    TYPE conv, tmp, err, chksum;
-   TYPE *A, *b, *x1, *x2, *xnew, *xold, *xtmp; 
+   ATYPE *A;           // float with -DMIXED (see mm_utils.h)
+   TYPE *b, *x1, *x2, *xnew, *xold, *xtmp; 
 
 // set matrix dimensions and allocate memory for matrices
    if(argc ==2){
@@ -64,11 +65,14 @@ int main(int argc, char **argv)
    }
 
    printf(" \n\nJacobi solver, target and data regions ndim = %d\n",Ndim);
+#ifdef MIXED
+   printf(" A stored in float, x and sums in double\n");
+#endif
 
-   A    = (TYPE *) malloc(Ndim*Ndim*sizeof(TYPE));
-   b    = (TYPE *) malloc(Ndim*sizeof(TYPE));
-   x1   = (TYPE *) malloc(Ndim*sizeof(TYPE));
-   x2   = (TYPE *) malloc(Ndim*sizeof(TYPE));
+   A    = (ATYPE *) mm_malloc(Ndim*Ndim*sizeof(ATYPE));
+   b    = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+   x1   = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+   x2   = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
 
    if (!A || !b || !x1 || !x2)
    {
@@ -77,9 +81,10 @@ int main(int argc, char **argv)
    }
 
    // generate our diagonally dominant matrix, A
-   init_diag_dom_near_identity_matrix(Ndim, A);
+   init_diag_dom_near_identity_matrix_a(Ndim, A);
+   mm_alloc_report("A", A);
 
-#ifdef VERBOSE
+#if defined(VERBOSE) && !defined(MIXED)
    mm_print(Ndim, Ndim, A);
 #endif
 
@@ -169,8 +174,8 @@ int main(int argc, char **argv)
    if (err > TOLERANCE)
       printf("\nWARNING: final solution error > %g\n\n", TOLERANCE);
 
-  free(A);
-  free(b);
-  free(x1);
-  free(x2);
+  mm_free(A);
+  mm_free(b);
+  mm_free(x1);
+  mm_free(x2);
 }
@@ -0,0 +1,2739 @@
+//
+// A reentrant Jacobi solver.  See jac_solver.h for the interface
+// and jac_solv.c for a description of the method.
+//
+// Each backend is a copy of the while loop from the matching
+// jac_solv program with the globals replaced by solver fields.
+//
+#include <math.h>
+#include <string.h>
+#include <sched.h>
+#include "jac_solver.h"
+#include "jac_rcm.h"
+
+#define LARGE     1000000.0
+
+#define JAC_TASKS_PER_THREAD 4   // row blocks per thread for JAC_TASK
+
+//#define DEBUG    1     // output a small subset of intermediate values
+
+static const char *backend_names[JAC_NUM_BACKENDS] = {
+   "serial", "parallel for", "parallel region", "target", "thread pool",
+   "task graph"
+};
+
+static const char *backend_short_names[JAC_NUM_BACKENDS] = {
+   "serial", "parfor", "region", "target", "pool", "task"
+};
+
+static const char *kernel_names[JAC_NUM_KERNELS] = {
+   "branchy", "split", "blocked", "simd"
+};
+
+static const char *storage_names[] = {
+   "dense", "packed", "banded", "CSR", "matrix-free", "Toeplitz",
+   "Kronecker", "diagonal plus low rank"
+};
+
+const char *jac_backend_name(jac_backend backend)
+{
+   if (backend < 0 || backend >= JAC_NUM_BACKENDS) return "unknown";
+   return backend_names[backend];
+}
+
+const char *jac_backend_short_name(jac_backend backend)
+{
+   if (backend < 0 || backend >= JAC_NUM_BACKENDS) return "unknown";
+   return backend_short_names[backend];
+}
+
+int jac_backend_from_name(const char *name)
+{
+   int i;
+   for (i=0; i<JAC_NUM_BACKENDS; i++)
+      if (!strcmp(name, backend_names[i]) ||
+          !strcmp(name, backend_short_names[i])) return i;
+   return -1;
+}
+
+const char *jac_kernel_name(jac_kernel kernel)
+{
+   if (kernel < 0 || kernel >= JAC_NUM_KERNELS) return "unknown";
+   return kernel_names[kernel];
+}
+
+int jac_kernel_from_name(const char *name)
+{
+   int i;
+   for (i=0; i<JAC_NUM_KERNELS; i++)
+      if (!strcmp(name, kernel_names[i])) return i;
+   return -1;
+}
+
+//
+// Packed storage: split the rows over nth threads so each gets
+// about the same number of stored elements.  Row i holds Ndim-i of
+// them, so the early rows are the long ones.
+//
+static void jac_packed_rows(int Ndim, int nth, int t, int *lo, int *hi)
+{
+   int  k, a, b, m;
+   size_t total = PACKED_SIZE(Ndim), goal;
+   int  bound[2];
+
+   for (k=0; k<2; k++){
+      goal = total/nth*(t+k) + total%nth*(t+k)/nth;
+      a = 0;  b = Ndim;      // first row starting at or past goal
+      while (a < b){
+         m = (a+b)/2;
+         if (PACKED_INDEX(Ndim, m, m) < goal) a = m+1;
+         else b = m;
+      }
+      bound[k] = a;
+   }
+   *lo = bound[0];
+   *hi = (t == nth-1) ? Ndim : bound[1];
+}
+
+//
+// nnz is the number of nonzeros for CSR storage, and the number of
+// elements A takes for the structured kinds
+//
+static jac_solver *jac_new(int Ndim, jac_backend backend,
+                           jac_storage storage, int bw, size_t nnz)
+{
+   int  lo, hi, blk, d;
+   size_t NA = (storage == JAC_PACKED) ? PACKED_SIZE(Ndim) :
+               (storage == JAC_BANDED) ? BAND_SIZE(Ndim, bw) :
+               (storage == JAC_DENSE)  ? (size_t)Ndim*Ndim :
+                                         nnz;
+   size_t k0, k1;
+   jac_solver *s = (jac_solver *) malloc(sizeof(jac_solver));
+   if (!s) return NULL;
+
+   s->Ndim      = Ndim;
+   s->backend   = backend;
+   s->storage   = storage;
+   s->bw        = bw;
+   s->seed      = 0;
+   s->kp        = 0;
+   s->kq        = 0;
+   s->rank      = 0;
+   s->lrw       = NULL;
+   s->lrparts   = NULL;
+   s->tolerance = (TYPE) JAC_TOLERANCE;
+   s->max_iters = JAC_MAX_ITERS;
+   s->fused     = 0;
+   s->kernel    = JAC_KERNEL_BRANCHY;
+   s->mixed     = 0;
+   s->Af        = NULL;
+   s->row_start = NULL;
+   s->gscale    = NULL;
+   s->col       = NULL;
+   s->perm      = NULL;
+   s->bperm     = NULL;
+   s->reorder_time = 0.0;
+   s->quant     = 0;
+   s->Aq        = NULL;
+   s->qscale    = NULL;
+   s->split     = 0;
+   s->block_rows = 1;
+   s->simd_path = NULL;
+   s->simd      = jac_simd_scalar();
+   s->check_every = 1;
+   s->async     = 0;
+   s->speculate = 0;
+   s->deterministic = 0;
+   s->parts     = NULL;
+   s->balance   = 0;
+   s->bal       = NULL;
+   s->tstats    = NULL;
+   s->ntstats   = 0;
+   s->nthreads  = 0;
+   s->sched_kind  = 0;
+   s->sched_chunk = 0;
+   s->checks    = 0;
+   s->replicas  = 1;
+   s->xrep      = NULL;
+   s->on_device = 0;
+   s->pool      = NULL;
+   s->iters     = 0;
+   s->conv      = (TYPE) 0.0;
+   s->elapsed_time = 0.0;
+
+   s->A  = (storage == JAC_GENERATED) ? NULL
+                                      : (TYPE *) mm_malloc(NA*sizeof(TYPE));
+   s->x1 = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+   s->x2 = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+   s->diag = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+   s->dinv = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+
+   if (storage == JAC_CSR){
+      s->row_start = (size_t *) mm_malloc((size_t)(Ndim+1)*sizeof(size_t));
+      s->col       = (int *) mm_malloc(nnz*sizeof(int));
+   }
+   if (storage == JAC_GENERATED)
+      s->gscale = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+
+   if ((storage != JAC_GENERATED && !s->A) ||
+       !s->x1 || !s->x2 || !s->diag || !s->dinv ||
+       (storage == JAC_CSR && (!s->row_start || !s->col)) ||
+       (storage == JAC_GENERATED && !s->gscale)){
+      jac_destroy(s);
+      return NULL;
+   }
+
+   // first touch with the row split the backends use
+   if (storage == JAC_PACKED){
+      #pragma omp parallel private(lo, hi)
+      {
+         jac_packed_rows(Ndim, omp_get_num_threads(),
+                         omp_get_thread_num(), &lo, &hi);
+         if (lo < hi)
+            memset(s->A + PACKED_INDEX(Ndim, lo, lo), 0,
+                   (PACKED_INDEX(Ndim, hi, hi) - PACKED_INDEX(Ndim, lo, lo))
+                   *sizeof(TYPE));
+      }
+   }
+   else if (storage == JAC_BANDED){
+      // the same static split over row blocks as solve_blocks
+      #pragma omp parallel for private(lo, hi, d) schedule(static)
+      for (blk=0; blk<(Ndim+JAC_BAND_ROWS-1)/JAC_BAND_ROWS; blk++){
+         lo = blk*JAC_BAND_ROWS;
+         hi = (lo+JAC_BAND_ROWS < Ndim) ? lo+JAC_BAND_ROWS : Ndim;
+         for (d=0; d<=2*bw; d++)
+            memset(s->A + (size_t)d*Ndim + lo, 0, (hi-lo)*sizeof(TYPE));
+      }
+   }
+   else if (storage == JAC_CSR){
+      // the rows aren't filled in yet, so assume they are all the
+      // same length and split the elements as solve_blocks will
+      // split the rows
+      #pragma omp parallel for private(lo, hi, k0, k1) schedule(static)
+      for (blk=0; blk<(Ndim+JAC_BAND_ROWS-1)/JAC_BAND_ROWS; blk++){
+         lo = blk*JAC_BAND_ROWS;
+         hi = (lo+JAC_BAND_ROWS < Ndim) ? lo+JAC_BAND_ROWS : Ndim;
+         k0 = (size_t)((double)nnz*lo/Ndim);
+         k1 = (hi == Ndim) ? nnz : (size_t)((double)nnz*hi/Ndim);
+         memset(s->A + k0, 0, (k1-k0)*sizeof(TYPE));
+         memset(s->col + k0, 0, (k1-k0)*sizeof(int));
+         memset(s->row_start + lo, 0, (hi-lo)*sizeof(size_t));
+      }
+      s->row_start[Ndim] = 0;
+   }
+   else if (storage == JAC_DENSE)
+      mm_first_touch(Ndim, Ndim, s->A);
+   mm_first_touch(Ndim, 1, s->x1);
+   mm_first_touch(Ndim, 1, s->x2);
+   return s;
+}
+
+jac_solver *jac_create(int Ndim, jac_backend backend)
+{
+   return jac_new(Ndim, backend, JAC_DENSE, 0, 0);
+}
+
+jac_solver *jac_create_packed(int Ndim, jac_backend backend)
+{
+   return jac_new(Ndim, backend, JAC_PACKED, 0, 0);
+}
+
+jac_solver *jac_create_banded(int Ndim, int bw, jac_backend backend)
+{
+   if (bw < 0) return NULL;
+   if (bw > Ndim-1) bw = Ndim-1;
+   return jac_new(Ndim, backend, JAC_BANDED, bw, 0);
+}
+
+jac_solver *jac_create_csr(int Ndim, size_t nnz, jac_backend backend)
+{
+   if (nnz < 1) return NULL;
+   return jac_new(Ndim, backend, JAC_CSR, 0, nnz);
+}
+
+jac_solver *jac_create_generated(int Ndim, unsigned seed,
+                                 jac_backend backend)
+{
+   jac_solver *s = jac_new(Ndim, backend, JAC_GENERATED, 0, 0);
+   if (s) s->seed = seed;
+   return s;
+}
+
+jac_solver *jac_create_toeplitz(int Ndim, jac_backend backend)
+{
+   return jac_new(Ndim, backend, JAC_TOEPLITZ, 0, (size_t)2*Ndim-1);
+}
+
+jac_solver *jac_create_kronecker(int kp, int kq, jac_backend backend)
+{
+   jac_solver *s;
+
+   if (kp < 1 || kq < 1) return NULL;
+   s = jac_new(kp*kq, backend, JAC_KRONECKER, 0,
+               (size_t)kp*kp + (size_t)kq*kq);
+   if (s){
+      s->kp = kp;
+      s->kq = kq;
+   }
+   return s;
+}
+
+//
+// The Toeplitz and Kronecker A are small and read by every thread,
+// so only the low rank one, whose rows of D, U and V go with the
+// rows of x, is first touched with the split solve_blocks uses
+//
+jac_solver *jac_create_lowrank(int Ndim, int k, jac_backend backend)
+{
+   int  blk, lo, hi;
+   jac_solver *s;
+
+   if (k < 1 || k > JAC_MAX_RANK) return NULL;
+   s = jac_new(Ndim, backend, JAC_LOWRANK, 0, (size_t)(2*k+1)*Ndim);
+   if (!s) return NULL;
+   s->rank = k;
+   s->lrw  = (TYPE *) mm_malloc(3*k*sizeof(TYPE));
+   if (!s->lrw){
+      jac_destroy(s);
+      return NULL;
+   }
+
+   #pragma omp parallel for private(lo, hi) schedule(static)
+   for (blk=0; blk<(Ndim+JAC_BAND_ROWS-1)/JAC_BAND_ROWS; blk++){
+      lo = blk*JAC_BAND_ROWS;
+      hi = (lo+JAC_BAND_ROWS < Ndim) ? lo+JAC_BAND_ROWS : Ndim;
+      memset(s->A + lo, 0, (hi-lo)*sizeof(TYPE));
+      memset(s->A + Ndim + (size_t)lo*k, 0, (size_t)(hi-lo)*k*sizeof(TYPE));
+      memset(s->A + Ndim + (size_t)(Ndim+lo)*k, 0,
+             (size_t)(hi-lo)*k*sizeof(TYPE));
+   }
+   return s;
+}
+
+void jac_destroy(jac_solver *s)
+{
+   if (!s) return;
+   if (s->on_device){
+      #pragma omp target exit data \
+                  map(delete:s->A[0:(size_t)s->Ndim*s->Ndim],s->dinv[0:s->Ndim])
+   }
+   jac_pool_destroy(s->pool);
+   mm_free(s->A);
+   mm_free(s->Af);
+   mm_free(s->row_start);
+   mm_free(s->col);
+   mm_free(s->gscale);
+   mm_free(s->lrw);
+   mm_free(s->lrparts);
+   mm_free(s->perm);
+   mm_free(s->bperm);
+   mm_free(s->Aq);
+   mm_free(s->qscale);
+   mm_free(s->x1);
+   mm_free(s->x2);
+   mm_free(s->diag);
+   mm_free(s->dinv);
+   mm_free(s->xrep);
+   mm_free(s->parts);
+   jac_balance_destroy(s->bal);
+   mm_free(s->tstats);
+   free(s);
+}
+
+//
+// Move the diagonal of A into diag (and its inverse into dinv) and
+// leave only the off-diagonal part in A.  A matrix whose diagonal
+// is already zero has been split before and is left alone.
+//
+static void jac_split_diag(jac_solver *s)
+{
+   int i, Ndim = s->Ndim;
+   TYPE *A = s->A;
+
+   if (s->split){
+      for (i=0; i<Ndim; i++)
+         if (A[(size_t)i*Ndim+i] != (TYPE) 0.0) break;
+      if (i == Ndim) return;
+   }
+   for (i=0; i<Ndim; i++){
+      s->diag[i]          = A[(size_t)i*Ndim+i];
+      s->dinv[i]          = (TYPE) 1.0/A[(size_t)i*Ndim+i];
+      A[(size_t)i*Ndim+i] = (TYPE) 0.0;
+   }
+   s->split = 1;
+}
+
+//
+// Put the diagonal back for kernels that want all of A.  A matrix
+// with any of its diagonal nonzero has been filled in again since
+// the split, so it keeps the diagonal it has and diag is made from
+// it, rather than the old one written over it.
+//
+static void jac_merge_diag(jac_solver *s)
+{
+   int i, Ndim = s->Ndim;
+   TYPE *A = s->A;
+
+   for (i=0; i<Ndim; i++)
+      if (A[(size_t)i*Ndim+i] != (TYPE) 0.0) break;
+   if (i == Ndim)
+      for (i=0; i<Ndim; i++)
+         A[(size_t)i*Ndim+i] = s->diag[i];
+   for (i=0; i<Ndim; i++){
+      s->diag[i] = A[(size_t)i*Ndim+i];
+      s->dinv[i] = (TYPE) 1.0/A[(size_t)i*Ndim+i];
+   }
+   s->split = 0;
+}
+
+//
+// Quantize row i of the split matrix to q.  Returns its scale.
+//
+static TYPE jac_quantize_row(int Ndim, const TYPE *a, int bits, void *q)
+{
+   int  j;
+   TYPE qmax = (bits == 8) ? (TYPE) 127.0 : (TYPE) 32767.0;
+   TYPE amax = (TYPE) 0.0, amin = (TYPE) 0.0, v, r, scale;
+
+   for (j=0; j<Ndim; j++){
+      v = (TYPE) fabs((double)a[j]);
+      if (v > amax) amax = v;
+      if (v > (TYPE) 0.0 && (amin == (TYPE) 0.0 || v < amin)) amin = v;
+   }
+   if (amax == (TYPE) 0.0) scale = (TYPE) 1.0;
+   else {
+      // whole multiples of the smallest element fit exactly
+      scale = amin;
+      if (amax/amin > qmax) scale = amax/qmax;
+      else
+         for (j=0; j<Ndim; j++){
+            r = a[j]/amin;
+            if (fabs((double)(r - (TYPE) floor((double)r + 0.5))) > 1.0e-6){
+               scale = amax/qmax;
+               break;
+            }
+         }
+   }
+   for (j=0; j<Ndim; j++){
+      v = (TYPE) floor((double)(a[j]/scale) + 0.5);
+      if (bits == 8) ((signed char *) q)[j] = (signed char) v;
+      else           ((short *) q)[j]       = (short) v;
+   }
+   return scale;
+}
+
+void jac_setup(jac_solver *s)
+{
+   TYPE *A = s->A;
+   int  i, j, Ndim = s->Ndim, nblk, nthreads;
+   size_t NN = (s->storage == JAC_DENSE) ? (size_t)s->Ndim*s->Ndim : 0;
+   size_t k;
+   unsigned key;
+   long rsum;
+
+   if (s->quant != 0 && s->quant != 8 && s->quant != 16){
+      printf("\n jac_setup: %d bit storage not supported, using A\n",
+             s->quant);
+      s->quant = 0;
+   }
+   if (s->storage != JAC_DENSE){
+      // the packed, banded, CSR, matrix-free and structured sweeps
+      // take the diagonal out as they go, so nothing is split off,
+      // and there are no float or quantized copies
+      if (s->storage == JAC_GENERATED){
+         // the row sums are worked out once; the elements are made
+         // again by every sweep
+         #pragma omp parallel for private(j, key, rsum) schedule(static)
+         for (i=0; i<Ndim; i++){
+            key = MM_HASH_ROW(s->seed, i);
+            for (rsum=0, j=0; j<Ndim; j++) rsum += MM_HASH_ELEM(key, j);
+            s->gscale[i] = (TYPE) 1.0/(TYPE) rsum;
+            s->diag[i]   = (TYPE)(MM_HASH_ELEM(key, i) + rsum)/(TYPE) rsum;
+            s->dinv[i]   = (TYPE) 1.0/s->diag[i];
+         }
+      }
+      else for (i=0; i<Ndim; i++){
+         if (s->storage == JAC_PACKED)
+            s->diag[i] = A[PACKED_INDEX(Ndim, i, i)];
+         else if (s->storage == JAC_BANDED)
+            s->diag[i] = A[BAND_INDEX(Ndim, s->bw, i, i)];
+         else if (s->storage == JAC_TOEPLITZ)
+            s->diag[i] = A[TOEP_INDEX(Ndim, i, i)];
+         else if (s->storage == JAC_KRONECKER)
+            // B[i1][i1]*C[i2][i2]
+            s->diag[i] = A[(size_t)(i/s->kq)*(s->kp+1)]
+                       * A[(size_t)s->kp*s->kp + (size_t)(i%s->kq)*(s->kq+1)];
+         else if (s->storage == JAC_LOWRANK){
+            // D[i] + U[i].V[i]
+            k = (size_t)i*s->rank;
+            s->diag[i] = A[i];
+            for (j=0; j<s->rank; j++)
+               s->diag[i] += A[Ndim + k + j]
+                           * A[Ndim + (size_t)Ndim*s->rank + k + j];
+         }
+         else {
+            s->diag[i] = (TYPE) 0.0;
+            for (k=s->row_start[i]; k<s->row_start[i+1]; k++)
+               if (s->col[k] == i) s->diag[i] = A[k];
+            if (s->diag[i] == (TYPE) 0.0)
+               printf("\n jac_setup: row %d has no diagonal element\n", i);
+         }
+         s->dinv[i] = (TYPE) 1.0/s->diag[i];
+      }
+      if (s->mixed || s->quant)
+         printf("\n jac_setup: %s storage is swept in full precision\n",
+                storage_names[s->storage]);
+      s->mixed = s->quant = 0;
+
+      // the rows may have changed, so the chunks are cut again by
+      // the next solve
+      jac_balance_destroy(s->bal);
+      s->bal = NULL;
+   }
+   else if (s->kernel == JAC_KERNEL_BRANCHY && !s->quant){
+      if (s->split) jac_merge_diag(s);
+   }
+   else
+      jac_split_diag(s);
+
+   // the backends hand out rows in blocks of this size
+   s->block_rows = (s->kernel == JAC_KERNEL_BLOCKED ||
+                    s->kernel == JAC_KERNEL_SIMD) ? JAC_BLOCK_ROWS : 1;
+
+   // only the simd kernel uses the hand vectorized code; the others
+   // get the scalar versions so their results are unchanged
+   s->simd = jac_simd_scalar();
+   if (s->kernel == JAC_KERNEL_SIMD){
+      s->simd = jac_simd_select(s->simd_path);
+      if (!s->simd){
+         printf("\n jac_setup: simd path %s not available, using the best one\n",
+                s->simd_path);
+         s->simd = jac_simd_select(NULL);
+      }
+   }
+
+   // the quantized copy of the off-diagonal part, rows spread over
+   // the threads with the same static schedule as mm_first_touch
+   mm_free(s->Aq);
+   mm_free(s->qscale);
+   s->Aq = NULL;
+   s->qscale = NULL;
+   if (s->quant){
+      s->Aq     = mm_malloc((size_t)NN*(s->quant/8));
+      s->qscale = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+      if (s->Aq && s->qscale){
+         #pragma omp parallel for schedule(static)
+         for (i=0; i<Ndim; i++)
+            s->qscale[i] = jac_quantize_row(Ndim, A + (size_t)i*Ndim,
+                              s->quant, (char *) s->Aq +
+                              (size_t)i*Ndim*(s->quant/8));
+      }
+      else {
+         printf("\n jac_setup: no memory for the quantized A, using A\n");
+         mm_free(s->Aq);
+         mm_free(s->qscale);
+         s->Aq = NULL;
+         s->qscale = NULL;
+         if (s->kernel == JAC_KERNEL_BRANCHY) jac_merge_diag(s);
+      }
+   }
+
+   // the float copy of A, made after the diagonal is split off so
+   // it holds what the sweep reads.  Rows are copied with the same
+   // static schedule as mm_first_touch, which places the pages.
+   mm_free(s->Af);
+   s->Af = NULL;
+   if (s->mixed && !s->Aq){
+      s->Af = (float *) mm_malloc((size_t)NN*sizeof(float));
+      if (s->Af){
+         #pragma omp parallel for private(j) schedule(static)
+         for (i=0; i<Ndim; i++)
+            for (j=0; j<Ndim; j++)
+               s->Af[(size_t)i*Ndim+j] = (float) A[(size_t)i*Ndim+j];
+      }
+      else
+         printf("\n jac_setup: no memory for a float copy of A, using A\n");
+   }
+
+   // one pair of xold/xnew copies per group of threads, each group
+   // touching its own so the pages land on its socket
+   mm_free(s->xrep);
+   s->xrep = NULL;
+   if (s->replicas > 1 && s->backend != JAC_SERIAL){
+      s->xrep = (TYPE *) mm_malloc((size_t)2*s->replicas*Ndim*sizeof(TYPE));
+      if (s->xrep)
+         mm_first_touch(2*s->replicas, Ndim, s->xrep);
+      else
+         printf("\n jac_setup: no memory for %d copies of x, using one\n",
+                s->replicas);
+   }
+
+   // two sets of per-block parts of conv for reproducible sums
+   mm_free(s->parts);
+   s->parts = NULL;
+   if (s->deterministic){
+      nblk = (Ndim + s->block_rows - 1)/s->block_rows;
+      s->parts = (TYPE *) mm_malloc((size_t)2*nblk*sizeof(TYPE));
+      if (!s->parts)
+         printf("\n jac_setup: no memory for reproducible sums\n");
+   }
+
+   // one pool thread per OpenMP thread, started once and kept
+   if (s->backend == JAC_POOL){
+      nthreads = (s->nthreads > 0) ? s->nthreads : omp_get_max_threads();
+      if (s->pool && jac_pool_size(s->pool) != nthreads){
+         jac_pool_destroy(s->pool);
+         s->pool = NULL;
+      }
+      if (!s->pool){
+         s->pool = jac_pool_create(nthreads);
+         if (!s->pool)
+            printf("\n jac_setup: no thread pool, jac_solve will fail\n");
+      }
+   }
+
+   // keep A resident on the device between solves so only the
+   // vectors move for each new right hand side
+   if (s->backend == JAC_TARGET && s->storage == JAC_DENSE){
+      if (s->on_device){
+         #pragma omp target update to(A[0:NN],s->dinv[0:Ndim])
+      }
+      else {
+         #pragma omp target enter data map(to:A[0:NN],s->dinv[0:Ndim])
+         s->on_device = 1;
+      }
+   }
+}
+
+//=========================================================
+// Sweep kernels
+//=========================================================
+
+//
+// The new value of x[i].  With split storage A holds only the
+// off-diagonal part, so the row is a branch-free dot product
+// followed by a multiply with the precomputed 1/A[i][i].  Used on
+// the host and inside target regions.
+//
+#pragma omp declare target
+static TYPE jac_row(int Ndim, const TYPE *A, const TYPE *b,
+                    const TYPE *dinv, const TYPE *xold, int i, int split)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   if (split){
+      #pragma omp simd reduction(+:sum)
+      for (j=0; j<Ndim; j++)
+          sum += A[(size_t)i*Ndim + j]*xold[j];
+      return (b[i]-sum)*dinv[i];
+   }
+   for (j=0; j<Ndim; j++){
+       if(i!=j)
+         sum += A[(size_t)i*Ndim + j]*xold[j];
+   }
+   return (b[i]-sum)/A[(size_t)i*Ndim+i];
+}
+#pragma omp end declare target
+
+// jac_row with A in float; each element is widened before the multiply
+static TYPE jac_row_mixed(int Ndim, const float *A, const TYPE *b,
+                    const TYPE *dinv, const TYPE *xold, int i, int split)
+{
+   int j;
+   TYPE sum = (TYPE) 0.0;
+   const float *a = A + (size_t)i*Ndim;
+   if (split){
+      #pragma omp simd reduction(+:sum)
+      for (j=0; j<Ndim; j++)
+          sum += (TYPE) a[j]*xold[j];
+      return (b[i]-sum)*dinv[i];
+   }
+   for (j=0; j<Ndim; j++){
+       if(i!=j)
+         sum += (TYPE) a[j]*xold[j];
+   }
+   return (b[i]-sum)/(TYPE) a[i];
+}
+
+//
+// Blocked version of the split kernel for rows lo to hi-1.  Rows
+// are taken JAC_BLOCK_ROWS at a time and the columns JAC_BLOCK_COLS
+// at a time, so a block of xold stays in L1 while it is used by all
+// the rows.  Inside a column block four rows are swept together
+// (unroll and jam) so each xold[j] loaded feeds four multiplies.
+//
+static void jac_sweep_rows_blocked(const jac_solver *s, const TYPE *b,
+                     const TYPE *xold, TYPE *xnew, int lo, int hi)
+{
+   int  i, j, i0, i1, jb, jend, Ndim = s->Ndim;
+   const TYPE *A = s->A, *a0, *a1, *a2, *a3;
+   TYPE s0, s1, s2, s3, xj;
+   TYPE acc[JAC_BLOCK_ROWS];
+
+   for (i0=lo; i0<hi; i0+=JAC_BLOCK_ROWS){
+      i1 = (i0+JAC_BLOCK_ROWS < hi) ? i0+JAC_BLOCK_ROWS : hi;
+      for (i=i0; i<i1; i++) acc[i-i0] = (TYPE) 0.0;
+
+      for (jb=0; jb<Ndim; jb+=JAC_BLOCK_COLS){
+         jend = (jb+JAC_BLOCK_COLS < Ndim) ? jb+JAC_BLOCK_COLS : Ndim;
+
+         for (i=i0; i+3<i1; i+=4){
+            a0 = A + (size_t)i*Ndim;
+            a1 = a0 + Ndim;
+            a2 = a1 + Ndim;
+            a3 = a2 + Ndim;
+            s0 = s1 = s2 = s3 = (TYPE) 0.0;
+            #pragma omp simd reduction(+:s0,s1,s2,s3) private(xj)
+            for (j=jb; j<jend; j++){
+               xj  = xold[j];
+               s0 += a0[j]*xj;
+               s1 += a1[j]*xj;
+               s2 += a2[j]*xj;
+               s3 += a3[j]*xj;
+            }
+            acc[i-i0]   += s0;
+            acc[i-i0+1] += s1;
+            acc[i-i0+2] += s2;
+            acc[i-i0+3] += s3;
+         }
+         for (; i<i1; i++){
+            a0 = A + (size_t)i*Ndim;
+            s0 = (TYPE) 0.0;
+            #pragma omp simd reduction(+:s0)
+            for (j=jb; j<jend; j++)
+               s0 += a0[j]*xold[j];
+            acc[i-i0] += s0;
+         }
+      }
+      for (i=i0; i<i1; i++)
+         xnew[i] = (b[i]-acc[i-i0])*s->dinv[i];
+   }
+}
+
+//
+// xnew = (b-(L+U)xold)/D for rows lo to hi-1
+//
+static void jac_sweep_rows(const jac_solver *s, const TYPE *b,
+                     const TYPE *xold, TYPE *xnew, int lo, int hi)
+{
+   int i, Ndim = s->Ndim;
+   if (s->Aq){
+      // the simd kernel gets the vector dots, the others plain C
+      if (s->quant == 8)
+         for (i=lo; i<hi; i++)
+            xnew[i] = (b[i] - s->qscale[i]*s->simd->dot_q8(Ndim,
+                        (const signed char *) s->Aq + (size_t)i*Ndim, xold))
+                      *s->dinv[i];
+      else
+         for (i=lo; i<hi; i++)
+            xnew[i] = (b[i] - s->qscale[i]*s->simd->dot_q16(Ndim,
+                        (const short *) s->Aq + (size_t)i*Ndim, xold))
+                      *s->dinv[i];
+      return;
+   }
+   if (s->Af){
+      if (s->kernel == JAC_KERNEL_SIMD)
+         for (i=lo; i<hi; i++)
+            xnew[i] = (b[i] - s->simd->dot_mixed(Ndim,
+                              s->Af + (size_t)i*Ndim, xold))*s->dinv[i];
+      else
+         for (i=lo; i<hi; i++)
+            xnew[i] = jac_row_mixed(Ndim, s->Af, b, s->dinv, xold, i,
+                                    s->split);
+      return;
+   }
+   if (s->kernel == JAC_KERNEL_BLOCKED){
+      jac_sweep_rows_blocked(s, b, xold, xnew, lo, hi);
+      return;
+   }
+   if (s->kernel == JAC_KERNEL_SIMD){
+      for (i=lo; i<hi; i++)
+         xnew[i] = (b[i] - s->simd->dot(Ndim, s->A + (size_t)i*Ndim, xold))
+                   *s->dinv[i];
+      return;
+   }
+   for (i=lo; i<hi; i++)
+      xnew[i] = jac_row(s->Ndim, s->A, b, s->dinv, xold, i, s->split);
+}
+
+//
+// Same as jac_sweep_rows, but also return the sum of (xnew-xold)^2
+// over the rows so the convergence test needs no second pass.
+//
+static TYPE jac_sweep_rows_conv(const jac_solver *s, const TYPE *b,
+                     const TYPE *xold, TYPE *xnew, int lo, int hi)
+{
+   jac_sweep_rows(s, b, xold, xnew, lo, hi);
+   return s->simd->sqdiff(hi-lo, xnew+lo, xold+lo);
+}
+
+//
+// Per-socket copies of x.  With s->replicas > 1 the threads are split
+// into that many groups by thread number (so bind them compactly,
+// e.g. OMP_PROC_BIND=close) and each group reads xold from its own
+// copy instead of from one vector on a remote socket.  Every block
+// of xnew is pushed to all the copies as it is computed, so this
+// costs no extra barrier.  Slot 0 of a copy mirrors x1, slot 1 x2.
+//
+static TYPE *jac_replica(const jac_solver *s, int r, const TYPE *x)
+{
+   return s->xrep + ((size_t)2*r + (x == s->x1 ? 0 : 1))*s->Ndim;
+}
+
+static const TYPE *jac_xin(const jac_solver *s, const TYPE *xold)
+{
+   int r;
+   if (!s->xrep) return xold;
+   r = omp_get_thread_num()*s->replicas/omp_get_num_threads();
+   return jac_replica(s, r, xold);
+}
+
+static void jac_push_replicas(const jac_solver *s, const TYPE *xnew,
+                     int lo, int hi)
+{
+   int r;
+   if (!s->xrep) return;
+   for (r=0; r<s->replicas; r++)
+      memcpy(jac_replica(s, r, xnew)+lo, xnew+lo, (hi-lo)*sizeof(TYPE));
+}
+
+// the parallel backends share out rows in blocks of s->block_rows
+static int jac_num_blocks(const jac_solver *s)
+{
+   return (s->Ndim + s->block_rows - 1)/s->block_rows;
+}
+
+static void jac_sweep_block(const jac_solver *s, const TYPE *b,
+                     const TYPE *xold, TYPE *xnew, int blk)
+{
+   int lo = blk*s->block_rows;
+   int hi = (lo+s->block_rows < s->Ndim) ? lo+s->block_rows : s->Ndim;
+   jac_sweep_rows(s, b, jac_xin(s, xold), xnew, lo, hi);
+   jac_push_replicas(s, xnew, lo, hi);
+}
+
+static TYPE jac_conv_block(const jac_solver *s, const TYPE *xnew,
+                     const TYPE *xold, int blk)
+{
+   int lo = blk*s->block_rows;
+   int hi = (lo+s->block_rows < s->Ndim) ? lo+s->block_rows : s->Ndim;
+   return s->simd->sqdiff(hi-lo, xnew+lo, xold+lo);
+}
+
+static TYPE jac_sweep_block_conv(const jac_solver *s, const TYPE *b,
+                     const TYPE *xold, TYPE *xnew, int blk)
+{
+   int lo = blk*s->block_rows;
+   int hi = (lo+s->block_rows < s->Ndim) ? lo+s->block_rows : s->Ndim;
+   TYPE conv = jac_sweep_rows_conv(s, b, jac_xin(s, xold), xnew, lo, hi);
+   jac_push_replicas(s, xnew, lo, hi);
+   return conv;
+}
+
+//=========================================================
+// Reproducible sums.  With s->deterministic set, conv is not summed
+// in whatever order the threads finish.  Each row block's part goes
+// in its own element of s->parts, and the parts are added with
+// jac_tree_sum, whose order depends only on the number of blocks.
+// The blocks depend on the kernel but not on the number of threads,
+// so conv (and with it the iteration count and the answer) comes out
+// bit for bit the same for any thread count and any backend except
+// async and target.  The simd path must match too, since it sets
+// the order of the sums inside a block.
+//=========================================================
+#define JAC_TREE_LEAF 8
+
+static TYPE jac_tree_sum(int n, const TYPE *a)
+{
+   int  i;
+   TYPE sum = (TYPE) 0.0;
+   if (n <= JAC_TREE_LEAF){
+      for (i=0; i<n; i++)
+         sum += a[i];
+      return sum;
+   }
+   return jac_tree_sum(n/2, a) + jac_tree_sum(n - n/2, a + n/2);
+}
+
+// where the parts of conv for iteration it go, or NULL if the sums
+// need not be reproducible.  Two sets alternate, so threads can fill
+// in the next set while others are still adding up this one.
+static TYPE *jac_parts(const jac_solver *s, int it)
+{
+   if (!s->parts) return NULL;
+   return s->parts + (size_t)(it%2)*jac_num_blocks(s);
+}
+
+// the parts of conv for a whole sweep; shares out the blocks if
+// called inside a parallel region
+static void jac_conv_parts(const jac_solver *s, const TYPE *xnew,
+                     const TYPE *xold, TYPE *parts)
+{
+   int i, nblk = jac_num_blocks(s);
+   #pragma omp for schedule(runtime)
+   for (i=0; i<nblk; i++)
+      parts[i] = jac_conv_block(s, xnew, xold, i);
+}
+
+//=========================================================
+// When to test for convergence.  With s->check_every = k > 0 the
+// test is made every k iterations.  With k = 0 the interval adapts:
+// the rate of convergence is estimated from the last two tests, and
+// the next test is scheduled after half the iterations that rate
+// says are still needed (at most JAC_MAX_CHECK_INTERVAL).  As the
+// solution nears the tolerance the interval shrinks back to one, so
+// the overshoot past the iteration that converged stays small.  A
+// test is always made on the last allowed iteration.
+//=========================================================
+typedef struct {
+   int    every;       // s->check_every
+   int    max_iters;
+   double tol;
+   int    next;        // iteration of the next test
+   int    last_it;     // iteration and result of the last test
+   double last_conv;
+   int    checks;      // tests made so far
+} jac_check_ctl;
+
+static void jac_check_init(jac_check_ctl *c, const jac_solver *s)
+{
+   c->every     = s->check_every;
+   c->max_iters = s->max_iters;
+   c->tol       = (double) s->tolerance;
+   c->next      = (c->every > 0) ? c->every : 1;
+   c->last_it   = 0;
+   c->last_conv = 0.0;
+   c->checks    = 0;
+}
+
+static int jac_check_due(const jac_check_ctl *c, int it)
+{
+   return (it >= c->next) || (it >= c->max_iters);
+}
+
+// record the result of a test made at iteration it
+static void jac_check_update(jac_check_ctl *c, int it, double conv)
+{
+   double rate, remaining;
+   int    k = 1;
+
+   c->checks++;
+   if (c->every > 0){
+      c->next = it + c->every;
+      return;
+   }
+   if (c->last_it > 0 && conv > 0.0 && conv < c->last_conv){
+      rate      = pow(conv/c->last_conv, 1.0/(double)(it - c->last_it));
+      remaining = log(c->tol/conv)/log(rate);
+      if (remaining > 2.0*JAC_MAX_CHECK_INTERVAL)
+         k = JAC_MAX_CHECK_INTERVAL;
+      else if (remaining > 2.0)
+         k = (int) (remaining/2.0);
+   }
+   c->last_it   = it;
+   c->last_conv = conv;
+   c->next      = it + k;
+}
+
+//=========================================================
+// Backends.  Each one leaves the final iterate in *xresult
+//=========================================================
+static void solve_serial(jac_solver *s, const TYPE *b, TYPE **xresult)
+{
+   int  Ndim = s->Ndim, check;
+   TYPE conv = (TYPE) LARGE;
+   TYPE *xnew = s->x1, *xold = s->x2, *xtmp;
+   int  iters = 0;
+   jac_check_ctl ctl;
+
+   jac_check_init(&ctl, s);
+   while((conv > s->tolerance) && (iters<s->max_iters))
+   {
+     iters++;
+     xtmp  = xnew;   // don't copy arrays.
+     xnew  = xold;   // just swap pointers.
+     xold  = xtmp;
+
+     check = jac_check_due(&ctl, iters);
+     if (!check){
+        jac_sweep_rows(s, b, xold, xnew, 0, Ndim);
+        continue;
+     }
+     if (s->parts){
+        jac_sweep_rows(s, b, xold, xnew, 0, Ndim);
+        jac_conv_parts(s, xnew, xold, s->parts);
+        conv = jac_tree_sum(jac_num_blocks(s), s->parts);
+     }
+     else if (s->fused){
+        conv = jac_sweep_rows_conv(s, b, xold, xnew, 0, Ndim);
+     }
+     else {
+        jac_sweep_rows(s, b, xold, xnew, 0, Ndim);
+        conv = s->simd->sqdiff(Ndim, xnew, xold);
+     }
+     conv = sqrt((double)conv);
+     jac_check_update(&ctl, iters, conv);
+#ifdef DEBUG
+     printf(" conv = %f \n",(float)conv);
+#endif
+   }
+   s->iters  = iters;
+   s->conv   = conv;
+   s->checks = ctl.checks;
+   *xresult  = xnew;
+}
+
+static void solve_par_for(jac_solver *s, const TYPE *b, TYPE **xresult)
+{
+   int  i, nblk = jac_num_blocks(s), check;
+   TYPE conv = (TYPE) LARGE, *parts = s->parts;
+   TYPE *xnew = s->x1, *xold = s->x2, *xtmp;
+   int  iters = 0;
+   jac_check_ctl ctl;
+
+   jac_check_init(&ctl, s);
+   while((conv > s->tolerance) && (iters<s->max_iters))
+   {
+     iters++;
+     xtmp  = xnew;   // don't copy arrays.
+     xnew  = xold;   // just swap pointers.
+     xold  = xtmp;
+
+     check = jac_check_due(&ctl, iters);
+     if (!check){
+        #pragma omp parallel for schedule(runtime)
+        for (i=0; i<nblk; i++)
+            jac_sweep_block(s, b, xold, xnew, i);
+        continue;
+     }
+     conv = 0.0;
+     if (parts && s->fused){
+        #pragma omp parallel for schedule(runtime)
+        for (i=0; i<nblk; i++)
+            parts[i] = jac_sweep_block_conv(s, b, xold, xnew, i);
+        conv = jac_tree_sum(nblk, parts);
+     }
+     else if (parts){
+        #pragma omp parallel for schedule(runtime)
+        for (i=0; i<nblk; i++)
+            jac_sweep_block(s, b, xold, xnew, i);
+
+        #pragma omp parallel
+        jac_conv_parts(s, xnew, xold, parts);
+        conv = jac_tree_sum(nblk, parts);
+     }
+     else if (s->fused){
+        #pragma omp parallel for schedule(runtime) reduction(+:conv)
+        for (i=0; i<nblk; i++)
+            conv += jac_sweep_block_conv(s, b, xold, xnew, i);
+     }
+     else {
+        #pragma omp parallel for schedule(runtime)
+        for (i=0; i<nblk; i++)
+            jac_sweep_block(s, b, xold, xnew, i);
+
+        #pragma omp parallel for schedule(runtime) reduction(+:conv)
+        for (i=0; i<nblk; i++)
+            conv += jac_conv_block(s, xnew, xold, i);
+     }
+     conv = sqrt((double)conv);
+     jac_check_update(&ctl, iters, conv);
+#ifdef DEBUG
+     printf(" conv = %f \n",(float)conv);
+#endif
+   }
+   s->iters  = iters;
+   s->conv   = conv;
+   s->checks = ctl.checks;
+   *xresult  = xnew;
+}
+
+static void solve_par_region(jac_solver *s, const TYPE *b, TYPE **xresult)
+{
+   int  i, nblk = jac_num_blocks(s), check = 0;
+   TYPE conv = (TYPE) LARGE;
+   TYPE tol2 = s->tolerance*s->tolerance;
+   TYPE *xnew = s->x1, *xold = s->x2, *xtmp;
+   int  iters = 0, max_iters = s->max_iters;
+   jac_check_ctl ctl;
+
+   jac_check_init(&ctl, s);
+
+   #pragma omp parallel private(i) \
+                shared (s, nblk, conv, iters, b, xnew, xold, xtmp, tol2, \
+                        max_iters, ctl, check)
+   {
+   // note: comparing against the convergence squared saves a
+   // sqrt and an extra barrier.
+   while((conv > tol2) && (iters<max_iters))
+   {
+     #pragma omp single
+     {
+        if (check) jac_check_update(&ctl, iters, sqrt((double)conv));
+        xtmp  = xnew;   // don't copy arrays.
+        xnew  = xold;   // just swap pointers.
+        xold  = xtmp;
+     }
+     #pragma omp for schedule(runtime) nowait
+     for (i=0; i<nblk; i++)
+         jac_sweep_block(s, b, xold, xnew, i);
+
+     #pragma omp single
+     {
+        iters++;
+        check = jac_check_due(&ctl, iters);
+        if (check) conv = 0.0;
+     }
+     // iterations that don't test skip the reduction and its barrier
+     if (check && s->parts){
+        jac_conv_parts(s, xnew, xold, s->parts);
+        #pragma omp single
+        conv = jac_tree_sum(nblk, s->parts);
+     }
+     else if (check){
+        #pragma omp for schedule(runtime) reduction(+:conv)
+        for (i=0; i<nblk; i++)
+            conv += jac_conv_block(s, xnew, xold, i);
+     }
+   }
+   }
+   if (check) ctl.checks++;
+   s->iters  = iters;
+   s->conv   = sqrt((double)conv);
+   s->checks = ctl.checks;
+   *xresult  = xnew;
+}
+
+//
+// Fused version of solve_par_region: one barrier per iteration.
+// Each thread keeps its own copy of the xnew/xold pointers and the
+// iteration count so no single construct is needed to swap them,
+// and accumulates its rows' share of conv while sweeping.  The sums
+// rotate through three slots so the master can clear the slot for
+// the next iteration while other threads may still be reading the
+// slot from the previous one.  Every thread runs its own copy of
+// the convergence test schedule; they all see the same sums, so
+// they all make the same decisions.
+//
+static void solve_par_region_fused(jac_solver *s, const TYPE *b,
+                                   TYPE **xresult)
+{
+   int  nblk = jac_num_blocks(s);
+   TYPE convs[3];
+   TYPE tol2 = s->tolerance*s->tolerance;
+   TYPE *x1 = s->x1, *x2 = s->x2;
+   int  max_iters = s->max_iters;
+
+   convs[0] = convs[1] = convs[2] = (TYPE) 0.0;
+
+   #pragma omp parallel shared (s, nblk, convs, b, x1, x2, tol2, max_iters)
+   {
+   int  i, it = 0, check;
+   TYPE my_conv, conv = (TYPE) LARGE;
+   TYPE *xnew = x1, *xold = x2, *xtmp, *parts = NULL;
+   jac_check_ctl ctl;
+
+   jac_check_init(&ctl, s);
+   while((conv > tol2) && (it<max_iters))
+   {
+     it++;
+     xtmp  = xnew;   // every thread swaps its own pointers
+     xnew  = xold;
+     xold  = xtmp;
+
+     check = jac_check_due(&ctl, it);
+     parts = jac_parts(s, it);
+     if (check && parts){
+        #pragma omp for schedule(runtime) nowait
+        for (i=0; i<nblk; i++)
+            parts[i] = jac_sweep_block_conv(s, b, xold, xnew, i);
+     }
+     else if (check){
+        my_conv = (TYPE) 0.0;
+        #pragma omp for schedule(runtime) nowait
+        for (i=0; i<nblk; i++)
+            my_conv += jac_sweep_block_conv(s, b, xold, xnew, i);
+
+        #pragma omp atomic
+        convs[it%3] += my_conv;
+     }
+     else {
+        #pragma omp for schedule(runtime) nowait
+        for (i=0; i<nblk; i++)
+            jac_sweep_block(s, b, xold, xnew, i);
+     }
+
+     #pragma omp master
+     convs[(it+1)%3] = (TYPE) 0.0;
+
+     #pragma omp barrier
+     if (check){
+        conv = parts ? jac_tree_sum(nblk, parts) : convs[it%3];
+        jac_check_update(&ctl, it, sqrt((double)conv));
+     }
+   }
+   #pragma omp master
+   {
+     s->iters  = it;
+     s->conv   = sqrt((double)conv);
+     s->checks = ctl.checks;
+     *xresult  = xnew;
+   }
+   }
+}
+
+//
+// Asynchronous (chaotic) version of solve_par_region.  There is no
+// barrier in the loop: each thread sweeps its own contiguous range
+// of rows from whatever values of x the other threads have written
+// so far, then copies its new rows into x.  For a diagonally
+// dominant A this still converges.  Two things keep it in check:
+//
+//  - bounded staleness: a thread waits before starting an iteration
+//    that would put it s->async or more iterations ahead of the
+//    slowest thread, so no value it reads is older than that.
+//  - a lock-free convergence test: after each sweep a thread posts
+//    its part of ||xnew-xold||^2 and its iteration count in its own
+//    slot, then adds up the latest parts of all the threads.  A part
+//    can be small just because its rows were swept against stale
+//    values, so a sum under the tolerance is only believed once
+//    every thread has swept again since it was first seen and the
+//    sum is still under.  The thread that confirms it raises a flag
+//    that the others poll.  After the threads stop, one synchronous
+//    sweep checks the answer; if it has not really converged the
+//    threads start sweeping asynchronously again.
+//
+// Reading rows while another thread writes them is a race in the
+// strict sense; on the machines we run on aligned doubles are read
+// and written whole, and the flush after each sweep bounds how long
+// new values stay invisible.  s->fused and s->check_every are not
+// used in this mode.
+//
+typedef union {
+   struct {
+      int  it;        // iterations this thread has finished
+      TYPE part;      // its rows' share of conv from its last sweep
+   } t;
+   char pad[64];      // one slot per cache line
+} jac_async_slot;
+
+static void solve_par_region_async(jac_solver *s, const TYPE *b,
+                                   TYPE **xresult)
+{
+   int  nblk = jac_num_blocks(s), lag = s->async, budget;
+   int  i, nslots = omp_get_max_threads(), done, iters = 0, phase;
+   TYPE conv = (TYPE) LARGE;
+   TYPE tol2 = s->tolerance*s->tolerance;
+   TYPE *x = s->x1, *xnew = s->x2;
+   jac_async_slot *slot;
+
+   slot = (jac_async_slot *) malloc(nslots*sizeof(jac_async_slot));
+   if (!slot){
+      printf("\n jac_solve: no memory for async mode, using region\n");
+      solve_par_region(s, b, xresult);
+      return;
+   }
+
+   while (iters < s->max_iters)
+   {
+   for (i=0; i<nslots; i++){
+      slot[i].t.it   = 0;
+      slot[i].t.part = (TYPE) LARGE;
+   }
+   done   = 0;
+   budget = s->max_iters - iters;
+
+   #pragma omp parallel num_threads(nslots) \
+                shared (s, b, x, xnew, slot, nblk, budget, lag, tol2, done)
+   {
+   int  tid = omp_get_thread_num(), nth = omp_get_num_threads();
+   int  lo = (tid*nblk/nth)*s->block_rows;
+   int  hi = ((tid+1)*nblk/nth)*s->block_rows;
+   int  j, t, it = 0, v, slow, fast, stop = 0, confirm = -1;
+   TYPE part, sum, tmp;
+
+   if (hi > s->Ndim) hi = s->Ndim;
+   while (!stop && it < budget)
+   {
+     // don't run lag or more iterations ahead of the slowest thread
+     for (;;){
+        slow = it;
+        for (t=0; t<nth; t++){
+           #pragma omp atomic read
+           v = slot[t].t.it;
+           if (v < slow) slow = v;
+        }
+        #pragma omp atomic read
+        stop = done;
+        if (stop || it - slow < lag) break;
+        sched_yield();
+     }
+     if (stop) break;
+
+     // xnew is only scratch space for this thread's rows
+     jac_sweep_rows(s, b, x, xnew, lo, hi);
+     part = (TYPE) 0.0;
+     for (j=lo; j<hi; j++){
+        tmp   = xnew[j]-x[j];
+        part += tmp*tmp;
+        x[j]  = xnew[j];
+     }
+     it++;
+     #pragma omp flush
+
+     #pragma omp atomic write
+     slot[tid].t.part = part;
+     #pragma omp atomic write
+     slot[tid].t.it = it;
+
+     sum  = (TYPE) 0.0;
+     slow = fast = it;
+     for (t=0; t<nth; t++){
+        #pragma omp atomic read
+        tmp = slot[t].t.part;
+        #pragma omp atomic read
+        v = slot[t].t.it;
+        sum += tmp;
+        if (v < slow) slow = v;
+        if (v > fast) fast = v;
+     }
+     if (sum > tol2)
+        confirm = -1;
+     else if (confirm < 0)
+        confirm = fast;          // believe it after one more round
+     else if (slow > confirm){
+        #pragma omp atomic write
+        done = 1;
+     }
+     #pragma omp atomic read
+     stop = done;
+   }
+   }
+
+   phase = 0;
+   for (i=0; i<nslots; i++)
+      if (slot[i].t.it > phase) phase = slot[i].t.it;
+   iters += phase;
+
+   // the test above is a heuristic, so check it with one ordinary
+   // synchronous sweep (which also counts as an iteration) and go
+   // back to sweeping asynchronously if it was a false alarm
+   conv = (TYPE) 0.0;
+   #pragma omp parallel for reduction(+:conv)
+   for (i=0; i<nblk; i++){
+      int lo = i*s->block_rows;
+      int hi = (lo+s->block_rows < s->Ndim) ? lo+s->block_rows : s->Ndim;
+      jac_sweep_rows(s, b, x, xnew, lo, hi);
+      conv += s->simd->sqdiff(hi-lo, xnew+lo, x+lo);
+   }
+   memcpy(x, xnew, s->Ndim*sizeof(TYPE));
+   iters++;
+   if (conv <= tol2) break;
+   }
+   free(slot);
+   s->iters  = iters;
+   s->checks = iters;
+   s->conv   = sqrt((double)conv);
+   *xresult  = x;
+}
+
+//
+// Speculative version of solve_par_region_fused.  Each thread posts
+// its part of the convergence sum for sweep k in its own slot and
+// goes straight on to sweep k+1 after the barrier.  The master adds
+// up the parts for sweep k at the start of sweep k+1, off everyone
+// else's critical path, and posts the verdict, which the others read
+// after the next barrier.  If sweep k had already converged, sweep
+// k+1 was wasted: it is dropped and the answer is the vector it read
+// from, so at most one sweep is thrown away per solve.
+//
+static void solve_par_region_spec(jac_solver *s, const TYPE *b,
+                                  TYPE **xresult)
+{
+   int  nblk = jac_num_blocks(s), nslots = omp_get_max_threads();
+   int  i, stop[2];
+   TYPE tol2 = s->tolerance*s->tolerance;
+   TYPE *x1 = s->x1, *x2 = s->x2;
+   jac_async_slot *parts;   // parts of sweep k go in slots (k%2)*nslots+tid
+
+   parts = (jac_async_slot *) malloc(2*nslots*sizeof(jac_async_slot));
+   if (!parts){
+      printf("\n jac_solve: no memory for speculation, using region\n");
+      solve_par_region_fused(s, b, xresult);
+      return;
+   }
+   for (i=0; i<2*nslots; i++) parts[i].t.part = (TYPE) 0.0;
+   stop[0] = stop[1] = 0;
+
+   #pragma omp parallel num_threads(nslots) \
+                shared (s, b, nblk, parts, stop, tol2, x1, x2, xresult)
+   {
+   int  i, t, it = 0, tid = omp_get_thread_num(), nth = omp_get_num_threads();
+   int  max_iters = s->max_iters;
+   TYPE my_conv, c, sum;
+   TYPE *xnew = x1, *xold = x2, *xtmp, *bparts;
+   jac_check_ctl ctl;   // only the master's copy is used
+
+   jac_check_init(&ctl, s);
+   for (;;)
+   {
+     it++;
+     xtmp  = xnew;   // every thread swaps its own pointers
+     xnew  = xold;
+     xold  = xtmp;
+
+     // per block parts too if the sum must be reproducible
+     bparts  = jac_parts(s, it);
+     my_conv = (TYPE) 0.0;
+     #pragma omp for schedule(runtime) nowait
+     for (i=0; i<nblk; i++){
+         c = jac_sweep_block_conv(s, b, xold, xnew, i);
+         if (bparts) bparts[i] = c;
+         my_conv += c;
+     }
+     parts[(it%2)*nslots + tid].t.part = my_conv;
+
+     // verdict on the previous sweep, whose parts are all in
+     if (tid == 0 && it > 1){
+        stop[(it-1)%2] = 0;
+        if (jac_check_due(&ctl, it-1)){
+           sum = (TYPE) 0.0;
+           for (t=0; t<nth; t++)
+              sum += parts[((it-1)%2)*nslots + t].t.part;
+           if (s->parts) sum = jac_tree_sum(nblk, jac_parts(s, it-1));
+           jac_check_update(&ctl, it-1, sqrt((double)sum));
+           stop[(it-1)%2] = (sum <= tol2);
+        }
+     }
+     #pragma omp barrier
+
+     if (it > 1 && stop[(it-1)%2]){
+        // converged one sweep ago: roll back to that sweep's result
+        it--;
+        xnew = xold;
+        break;
+     }
+     if (it >= max_iters) break;
+   }
+   #pragma omp master
+   {
+     sum = (TYPE) 0.0;
+     for (t=0; t<nth; t++)
+        sum += parts[(it%2)*nslots + t].t.part;
+     if (s->parts) sum = jac_tree_sum(nblk, jac_parts(s, it));
+     s->iters  = it;
+     s->conv   = sqrt((double)sum);
+     s->checks = ctl.checks;
+     *xresult  = xnew;
+   }
+   }
+   free(parts);
+}
+
+static void solve_target(jac_solver *s, const TYPE *b, TYPE **xresult)
+{
+   int  i, j, Ndim = s->Ndim, check;
+   TYPE tmp, conv = (TYPE) LARGE;
+   TYPE *A = s->A, *dinv = s->dinv, *xnew = s->x1, *xold = s->x2, *xtmp;
+   TYPE *bb = (TYPE *) b, *pp = s->parts;
+   int  iters = 0, fused = s->fused, split = s->split;
+   int  nblk = jac_num_blocks(s), brows = s->block_rows;
+   jac_check_ctl ctl;
+
+   jac_check_init(&ctl, s);
+
+   // A and dinv are already on the device (see jac_setup).  The
+   // blocked kernel is tuned for CPU caches, so on the device it
+   // runs as the plain split kernel.
+   #pragma omp target data map(tofrom:xnew[0:Ndim],xold[0:Ndim],conv) \
+                        map(to:bb[0:Ndim])
+   while((conv > s->tolerance) && (iters<s->max_iters))
+   {
+     iters++;
+     xtmp  = xnew;   // don't copy arrays.
+     xnew  = xold;   // just swap pointers.
+     xold  = xtmp;
+
+     check = jac_check_due(&ctl, iters);
+     if (fused && check && !pp){
+       // one kernel does the sweep and the convergence sum
+       #pragma omp target map(tofrom:conv)
+       {
+          conv = 0.0;
+          #pragma omp parallel for private(tmp) reduction(+:conv)
+          for (i=0; i<Ndim; i++){
+              xnew[i] = jac_row(Ndim, A, bb, dinv, xold, i, split);
+              tmp  = xnew[i]-xold[i];
+              conv += tmp*tmp;
+          }
+          conv = sqrt((double)conv);
+       }
+     }
+     else {
+       #pragma omp target
+         #pragma omp parallel for
+         for (i=0; i<Ndim; i++)
+             xnew[i] = jac_row(Ndim, A, bb, dinv, xold, i, split);
+
+       if (check && pp){
+         // a sum per block, added up on the host in a fixed order
+         #pragma omp target map(from:pp[0:nblk])
+         #pragma omp parallel for private(j, tmp)
+         for (i=0; i<nblk; i++){
+            pp[i] = 0.0;
+            for (j=i*brows; j<(i+1)*brows && j<Ndim; j++){
+               tmp    = xnew[j]-xold[j];
+               pp[i] += tmp*tmp;
+            }
+         }
+         conv = sqrt((double)jac_tree_sum(nblk, pp));
+         #pragma omp target update to(conv)
+       }
+       else if (check){
+         #pragma omp target map(tofrom:conv)
+         {
+            conv = 0.0;
+            #pragma omp parallel for private(tmp) reduction(+:conv)
+            for (i=0; i<Ndim; i++){
+              tmp  = xnew[i]-xold[i];
+              conv += tmp*tmp;
+            }
+            conv = sqrt((double)conv);
+         }
+       }
+     }
+     // only iterations that test wait for conv to come back
+     if (check){
+       if (!pp){
+         #pragma omp target update from(conv)
+       }
+       jac_check_update(&ctl, iters, conv);
+     }
+   }
+   s->iters  = iters;
+   s->conv   = conv;
+   s->checks = ctl.checks;
+   *xresult  = xnew;
+}
+
+//
+// Task graph backend.  The rows are cut into a few blocks per thread
+// and each block of each sweep is a task.  A task reads all of xold,
+// so it depends on every block of the previous sweep, and it writes
+// its block of xnew, which orders it after the tasks of the sweep
+// before that (they read the same vector).  A block of the next
+// sweep can therefore start as soon as the last block of this one
+// is done, on whichever thread is free, instead of waiting at a
+// barrier for every thread to finish.  On iterations that test for
+// convergence each task also stores its part of the sum, and only
+// then does the generating thread wait for the tasks to finish; so
+// with s->check_every > 1 (or 0) several sweeps are in flight.
+//
+// Create the tasks for one sweep.  This is a function of its own
+// because the compiler may put the dependence lists on the stack of
+// the function creating the tasks and only free them on return.
+static void jac_task_sweep(const jac_solver *s, const TYPE *b,
+                     const TYPE *xold, TYPE *xnew, int rows, int ntask,
+                     TYPE *parts)
+{
+   int i, blk;
+   for (i=0; i<ntask; i++){
+      #pragma omp task firstprivate(i) private(blk) \
+              depend(iterator(j=0:ntask), in: xold[j*rows]) \
+              depend(out: xnew[i*rows])
+      {
+         int lo = i*rows;
+         int hi = (lo+rows < s->Ndim) ? lo+rows : s->Ndim;
+         jac_sweep_rows(s, b, jac_xin(s, xold), xnew, lo, hi);
+         jac_push_replicas(s, xnew, lo, hi);
+         if (parts && s->parts){
+            // rows is a whole number of blocks
+            for (blk=lo/s->block_rows; blk*s->block_rows<hi; blk++)
+               s->parts[blk] = jac_conv_block(s, xnew, xold, blk);
+         }
+         else if (parts)
+            parts[i] = s->simd->sqdiff(hi-lo, xnew+lo, xold+lo);
+      }
+   }
+}
+
+static void solve_task(jac_solver *s, const TYPE *b, TYPE **xresult)
+{
+   int  Ndim = s->Ndim, nth = omp_get_max_threads();
+   int  i, rows, ntask, check, iters = 0;
+   TYPE conv = (TYPE) LARGE;
+   TYPE *xnew = s->x1, *xold = s->x2, *xtmp, *parts;
+   jac_check_ctl ctl;
+
+   rows  = (Ndim + JAC_TASKS_PER_THREAD*nth - 1)/(JAC_TASKS_PER_THREAD*nth);
+   rows  = ((rows + s->block_rows - 1)/s->block_rows)*s->block_rows;
+   ntask = (Ndim + rows - 1)/rows;
+   parts = (TYPE *) malloc(ntask*sizeof(TYPE));
+   if (!parts){
+      printf("\n jac_solve: no memory for the task graph, using region\n");
+      solve_par_region(s, b, xresult);
+      return;
+   }
+
+   jac_check_init(&ctl, s);
+
+   #pragma omp parallel shared(s, b, rows, ntask, parts, conv, iters, \
+                               xnew, xold, xtmp, ctl) private(i, check)
+   #pragma omp single
+   while((conv > s->tolerance) && (iters<s->max_iters))
+   {
+     iters++;
+     xtmp  = xnew;   // don't copy arrays.
+     xnew  = xold;   // just swap pointers.
+     xold  = xtmp;
+
+     check = jac_check_due(&ctl, iters);
+     jac_task_sweep(s, b, xold, xnew, rows, ntask, check ? parts : NULL);
+     if (check){
+        #pragma omp taskwait
+        conv = (TYPE) 0.0;
+        for (i=0; i<ntask; i++)
+           conv += parts[i];
+        if (s->parts) conv = jac_tree_sum(jac_num_blocks(s), s->parts);
+        conv = sqrt((double)conv);
+        jac_check_update(&ctl, iters, conv);
+     }
+   }
+   free(parts);
+   s->iters  = iters;
+   s->conv   = conv;
+   s->checks = ctl.checks;
+   *xresult  = xnew;
+}
+
+//
+// Thread pool backend.  Each thread owns a fixed, contiguous range
+// of row blocks for the whole solve, so it can compute its part of
+// the convergence sum right after its sweep (fused or not makes no
+// difference here) and the barrier that ends the iteration also
+// adds up the parts.  Every thread gets the same sum back and makes
+// the same decision about stopping, with no other synchronization.
+//
+typedef struct {
+   jac_solver *s;
+   const TYPE *b;
+   TYPE      **xresult;
+} jac_pool_job;
+
+static void solve_pool_thread(void *arg, int tid, int nthreads)
+{
+   jac_pool_job *job = (jac_pool_job *) arg;
+   jac_solver *s = job->s;
+   const TYPE *b = job->b, *xin;
+   int  nblk = jac_num_blocks(s), max_iters = s->max_iters;
+   int  blo = tid*nblk/nthreads, bhi = (tid+1)*nblk/nthreads;
+   int  lo = blo*s->block_rows, hi = bhi*s->block_rows;
+   int  i, it = 0, check;
+   TYPE *parts;
+   double my_conv, conv = LARGE;
+   double tol2 = (double)s->tolerance*s->tolerance;
+   TYPE *xnew = s->x1, *xold = s->x2, *xtmp;
+   jac_check_ctl ctl;
+
+   if (hi > s->Ndim) hi = s->Ndim;
+   jac_check_init(&ctl, s);
+   while((conv > tol2) && (it<max_iters))
+   {
+     it++;
+     xtmp  = xnew;   // every thread swaps its own pointers
+     xnew  = xold;
+     xold  = xtmp;
+
+     xin = xold;
+     if (s->xrep) xin = jac_replica(s, tid*s->replicas/nthreads, xold);
+
+     check = jac_check_due(&ctl, it);
+     parts = jac_parts(s, it);
+     if (check && parts){
+        jac_sweep_rows(s, b, xin, xnew, lo, hi);
+        jac_push_replicas(s, xnew, lo, hi);
+        for (i=blo; i<bhi; i++)
+           parts[i] = jac_conv_block(s, xnew, xold, i);
+        jac_pool_barrier(s->pool, tid);
+        conv = (double) jac_tree_sum(nblk, parts);
+        jac_check_update(&ctl, it, sqrt(conv));
+     }
+     else if (check){
+        my_conv = (double) jac_sweep_rows_conv(s, b, xin, xnew, lo, hi);
+        jac_push_replicas(s, xnew, lo, hi);
+        conv = jac_pool_barrier_sum(s->pool, tid, my_conv);
+        jac_check_update(&ctl, it, sqrt(conv));
+     }
+     else {
+        jac_sweep_rows(s, b, xin, xnew, lo, hi);
+        jac_push_replicas(s, xnew, lo, hi);
+        jac_pool_barrier(s->pool, tid);
+     }
+   }
+   if (tid == 0){
+     s->iters    = it;
+     s->conv     = (TYPE) sqrt(conv);
+     s->checks   = ctl.checks;
+     *job->xresult = xnew;
+   }
+}
+
+static void solve_pool(jac_solver *s, const TYPE *b, TYPE **xresult)
+{
+   jac_pool_job job;
+
+   job.s       = s;
+   job.b       = b;
+   job.xresult = xresult;
+   jac_pool_run(s->pool, solve_pool_thread, &job);
+}
+
+//=========================================================
+// Packed symmetric storage (jac_create_packed).  Only the upper
+// triangle is stored, so each element read does the work of two:
+// a[i][j] adds a[i][j]*x[j] to row i and a[i][j]*x[i] to row j.
+// Row j may belong to another thread, so each thread sums into its
+// own copy of the vector, from its first row on, and a second loop
+// adds the copies up and makes xnew (and conv, when it is due).
+// The rows are split so each thread reads the same number of
+// elements.  All backends use this sweep; the serial one with one
+// thread.
+//=========================================================
+static void solve_packed(jac_solver *s, const TYPE *b, TYPE **xresult)
+{
+   int  Ndim = s->Ndim, check = 0, iters = 0, max_iters = s->max_iters;
+   int  nth = (s->backend == JAC_SERIAL) ? 1 : omp_get_max_threads();
+   TYPE conv = (TYPE) LARGE, tol2 = s->tolerance*s->tolerance;
+   TYPE *xnew = s->x1, *xold = s->x2, *xtmp;
+   TYPE *y = (TYPE *) mm_malloc((size_t)nth*Ndim*sizeof(TYPE));
+   int  *first = (int *) malloc(nth*sizeof(int));
+   jac_check_ctl ctl;
+
+   if (!y || !first){
+      printf("\n jac_solve: memory allocation error\n");
+      mm_free(y);
+      free(first);
+      s->iters = 0;
+      *xresult = xnew;
+      return;
+   }
+   jac_check_init(&ctl, s);
+
+   #pragma omp parallel num_threads(nth) \
+                shared (s, b, y, first, nth, conv, iters, xnew, xold, xtmp, \
+                        tol2, max_iters, ctl, check)
+   {
+   int  t = omp_get_thread_num(), i, j, u, lo, hi;
+   TYPE *yt = y + (size_t)t*Ndim, sum, xi, tmp;
+   const TYPE *a;
+
+   jac_packed_rows(Ndim, nth, t, &lo, &hi);
+   first[t] = lo;
+   #pragma omp barrier
+
+   while((conv > tol2) && (iters<max_iters))
+   {
+     #pragma omp single
+     {
+        if (check) jac_check_update(&ctl, iters, sqrt((double)conv));
+        xtmp  = xnew;   // don't copy arrays.
+        xnew  = xold;   // just swap pointers.
+        xold  = xtmp;
+     }
+
+     // this thread's rows, and their mirror images in later rows
+     for (i=lo; i<Ndim; i++) yt[i] = (TYPE) 0.0;
+     for (i=lo; i<hi; i++){
+        a   = s->A + PACKED_INDEX(Ndim, i, i);
+        xi  = xold[i];
+        sum = (TYPE) 0.0;
+        #pragma omp simd reduction(+:sum)
+        for (j=i+1; j<Ndim; j++){
+           sum   += a[j-i]*xold[j];
+           yt[j] += a[j-i]*xi;
+        }
+        yt[i] += sum;
+     }
+
+     // (the barrier at the end of the single ends the sweep too)
+     #pragma omp single
+     {
+        iters++;
+        check = jac_check_due(&ctl, iters);
+        if (check) conv = 0.0;
+     }
+     if (check){
+        #pragma omp for schedule(static) reduction(+:conv)
+        for (i=0; i<Ndim; i++){
+           for (sum=(TYPE)0.0, u=0; u<nth; u++)
+              if (first[u] <= i) sum += y[(size_t)u*Ndim+i];
+           xnew[i] = (b[i]-sum)*s->dinv[i];
+           tmp   = xnew[i]-xold[i];
+           conv += tmp*tmp;
+        }
+     }
+     else {
+        #pragma omp for schedule(static)
+        for (i=0; i<Ndim; i++){
+           for (sum=(TYPE)0.0, u=0; u<nth; u++)
+              if (first[u] <= i) sum += y[(size_t)u*Ndim+i];
+           xnew[i] = (b[i]-sum)*s->dinv[i];
+        }
+     }
+   }
+   }
+   if (check) ctl.checks++;
+   s->iters  = iters;
+   s->conv   = sqrt((double)conv);
+   s->checks = ctl.checks;
+   *xresult  = xnew;
+   mm_free(y);
+   free(first);
+}
+
+//=========================================================
+// Banded, CSR, matrix-free and structured storage (jac_create_banded,
+// jac_create_csr, jac_create_generated, jac_create_toeplitz,
+// jac_create_kronecker, jac_create_lowrank).  They sweep the rows
+// in blocks, split statically over the threads to match the first
+// touch in jac_new, with the conv test fused in.  A block function
+// does the rows lo to hi-1 of iteration it and returns their part
+// of conv when check is set.  Only the low rank sweep uses it; the
+// others cast it to void.  All backends use these sweeps; the
+// serial one with one thread.  With s->balance set a CSR sweep is
+// instead cut by nonzeros (jac_balance.h) and threads that finish
+// early take chunks from the others.  Either way each thread's work
+// and time busy and idle is left in s->tstats.
+//=========================================================
+typedef TYPE (*jac_block_fn)(const jac_solver *s, const TYPE *b,
+                             const TYPE *xold, TYPE *xnew, int lo, int hi,
+                             int check, int it);
+
+//
+// Banded: A is kept by diagonals, so along any one diagonal both A
+// and xold are read in order.  The block's sums start at zero, each
+// off-diagonal in turn adds its part with a vector loop over the
+// rows, and then the block's xnew (and conv) is made while the sums
+// are still in L1.
+//
+static TYPE jac_band_block(const jac_solver *s, const TYPE *b,
+                           const TYPE *xold, TYPE *xnew, int lo, int hi,
+                           int check, int it)
+{
+   int  i, d, off, ilo, ihi, Ndim = s->Ndim, bw = s->bw;
+   const TYPE *a;
+   TYPE sum[JAC_BAND_ROWS] __attribute__((aligned(MM_ALIGN)));
+   TYPE tmp, conv = (TYPE) 0.0;
+
+   (void) it;
+   for (i=0; i<hi-lo; i++) sum[i] = (TYPE) 0.0;
+   for (d=0; d<=2*bw; d++){
+      if (d == bw) continue;
+      off = d - bw;           // this diagonal holds A[i][i+off]
+      ilo = (lo+off < 0) ? -off : lo;
+      ihi = (hi+off > Ndim) ? Ndim-off : hi;
+      a   = s->A + (size_t)d*Ndim;
+      if (ilo < ihi)
+         s->simd->mac(ihi-ilo, a+ilo, xold+ilo+off, sum+ilo-lo);
+   }
+   if (check){
+      #pragma omp simd private(tmp) reduction(+:conv)
+      for (i=lo; i<hi; i++){
+         xnew[i] = (b[i]-sum[i-lo])*s->dinv[i];
+         tmp   = xnew[i]-xold[i];
+         conv += tmp*tmp;
+      }
+   }
+   else {
+      #pragma omp simd
+      for (i=lo; i<hi; i++)
+         xnew[i] = (b[i]-sum[i-lo])*s->dinv[i];
+   }
+   return conv;
+}
+
+//
+// CSR: each row is a gathered dot product over its nonzeros.  The
+// diagonal is in the row too, so its part is taken back out.
+//
+static TYPE jac_csr_block(const jac_solver *s, const TYPE *b,
+                          const TYPE *xold, TYPE *xnew, int lo, int hi,
+                          int check, int it)
+{
+   int  i;
+   size_t k;
+   TYPE sum, tmp, conv = (TYPE) 0.0;
+
+   (void) it;
+   for (i=lo; i<hi; i++){
+      k   = s->row_start[i];
+      sum = s->simd->dot_gather((int)(s->row_start[i+1]-k), s->A+k,
+                                s->col+k, xold) - s->diag[i]*xold[i];
+      xnew[i] = (b[i]-sum)*s->dinv[i];
+      if (check){
+         tmp   = xnew[i]-xold[i];
+         conv += tmp*tmp;
+      }
+   }
+   return conv;
+}
+
+//
+// Matrix-free: the elements are made from the hash as the rows are
+// swept, JAC_GEN_COLS columns at a time for all the block's rows so
+// that piece of xold stays in L1.  Row i's elements start at
+// key+0, so key+c picks up a row at column c.  The raw sums are
+// scaled by the row's 1/S and the diagonal taken back out, as for
+// CSR.
+//
+static TYPE jac_gen_block(const jac_solver *s, const TYPE *b,
+                          const TYPE *xold, TYPE *xnew, int lo, int hi,
+                          int check, int it)
+{
+   int  i, c, n, Ndim = s->Ndim;
+   unsigned key[JAC_BLOCK_ROWS];
+   TYPE sum[JAC_BLOCK_ROWS];
+   TYPE tmp, conv = (TYPE) 0.0;
+
+   (void) it;
+   for (i=lo; i<hi; i++){
+      key[i-lo] = MM_HASH_ROW(s->seed, i);
+      sum[i-lo] = (TYPE) 0.0;
+   }
+   for (c=0; c<Ndim; c+=JAC_GEN_COLS){
+      n = (c+JAC_GEN_COLS < Ndim) ? JAC_GEN_COLS : Ndim-c;
+      for (i=lo; i<hi; i++)
+         sum[i-lo] += s->simd->dot_hash(n, key[i-lo] + (unsigned) c,
+                                        xold + c);
+   }
+   for (i=lo; i<hi; i++){
+      tmp     = (sum[i-lo] - MM_HASH_ELEM(key[i-lo], i)*xold[i])*s->gscale[i];
+      xnew[i] = (b[i]-tmp)*s->dinv[i];
+      if (check){
+         tmp   = xnew[i]-xold[i];
+         conv += tmp*tmp;
+      }
+   }
+   return conv;
+}
+
+//
+// Toeplitz: row i is the run of t starting at t[Ndim-1-i], so each
+// row is a plain dot product with xold.  As for the matrix-free
+// sweep, the block's rows go JAC_GEN_COLS columns at a time, and
+// with the whole of A in 2N-1 values the rows' runs overlap and are
+// read from cache.
+//
+static TYPE jac_toep_block(const jac_solver *s, const TYPE *b,
+                           const TYPE *xold, TYPE *xnew, int lo, int hi,
+                           int check, int it)
+{
+   int  i, c, n, Ndim = s->Ndim;
+   const TYPE *t = s->A + Ndim-1;     // t[j-i] is A[i][j]
+   TYPE sum[JAC_BLOCK_ROWS];
+   TYPE tmp, conv = (TYPE) 0.0;
+
+   (void) it;
+   for (i=lo; i<hi; i++) sum[i-lo] = (TYPE) 0.0;
+   for (c=0; c<Ndim; c+=JAC_GEN_COLS){
+      n = (c+JAC_GEN_COLS < Ndim) ? JAC_GEN_COLS : Ndim-c;
+      for (i=lo; i<hi; i++)
+         sum[i-lo] += s->simd->dot(n, t + c - i, xold + c);
+   }
+   for (i=lo; i<hi; i++){
+      tmp     = sum[i-lo] - t[0]*xold[i];
+      xnew[i] = (b[i]-tmp)*s->dinv[i];
+      if (check){
+         tmp   = xnew[i]-xold[i];
+         conv += tmp*tmp;
+      }
+   }
+   return conv;
+}
+
+//
+// Kronecker, B (p by p) times C (q by q): with xold taken as a p by
+// q matrix X, the rows i1*q to i1*q+q-1 of A*xold are C times row
+// i1 of B*X.  A block is g whole rows of B.  Their rows of B*X are
+// made a tile of JAC_KRON_COLS columns at a time in z (all of a
+// row when q is smaller, and then g*q <= JAC_BAND_ROWS), each tile
+// of a row of X serving all g, and then C's columns for the tile
+// take them into the sums, kept in xnew until the block is done.
+//
+static TYPE jac_kron_block(const jac_solver *s, const TYPE *b,
+                           const TYPE *xold, TYPE *xnew, int lo, int hi,
+                           int check, int it)
+{
+   int  i, r, c, j, j1, i2, n, p = s->kp, q = s->kq;
+   int  g = (hi-lo)/q, i1lo = lo/q, w = JAC_KRON_COLS;
+   const TYPE *B = s->A + (size_t)i1lo*p, *C = s->A + (size_t)p*p;
+   const TYPE *xr, *cr;
+   TYPE z[JAC_KRON_TILE] __attribute__((aligned(MM_ALIGN)));
+   TYPE *zr, bij, tmp, conv = (TYPE) 0.0;
+
+   (void) it;
+   for (i=lo; i<hi; i++) xnew[i] = (TYPE) 0.0;
+   for (c=0; c<q; c+=w){
+      n = (c+w < q) ? w : q-c;
+      for (j=0; j<g*n; j++) z[j] = (TYPE) 0.0;
+      for (j1=0; j1<p; j1++){
+         xr = xold + (size_t)j1*q + c;
+         for (r=0; r<g; r++){
+            bij = B[(size_t)r*p + j1];
+            zr  = z + r*n;
+            #pragma omp simd
+            for (j=0; j<n; j++) zr[j] += bij*xr[j];
+         }
+      }
+      for (i2=0; i2<q; i2++){
+         cr = C + (size_t)i2*q + c;
+         for (r=0; r<g; r++)
+            xnew[lo + r*q + i2] += s->simd->dot(n, cr, z + r*n);
+      }
+   }
+   for (i=lo; i<hi; i++){
+      tmp     = xnew[i] - s->diag[i]*xold[i];
+      xnew[i] = (b[i]-tmp)*s->dinv[i];
+      if (check){
+         tmp   = xnew[i]-xold[i];
+         conv += tmp*tmp;
+      }
+   }
+   return conv;
+}
+
+//
+// Diagonal plus low rank, D + U*V^T with U and V Ndim by k: row i
+// is U[i].(V^T xold) off the diagonal, less U[i].V[i] xold[i] (which
+// is diag[i]-D[i]).  V^T xold is one of three k long vectors in
+// s->lrw, taken in turn.  Each block adds its rows' part of V^T
+// xnew into the next, which nobody reads until after the barrier,
+// and the block with row 0 clears the one after, last read in the
+// iteration before this.  So it is still one barrier an iteration.
+// With s->deterministic set the blocks instead leave their parts in
+// s->lrparts, one row of blocks for each of the k elements, and
+// solve_blocks adds them up in a fixed order (jac_lowrank_sum).
+//
+static TYPE jac_lowrank_block(const jac_solver *s, const TYPE *b,
+                              const TYPE *xold, TYPE *xnew, int lo, int hi,
+                              int check, int it)
+{
+   int  i, l, k = s->rank, Ndim = s->Ndim;
+   int  nblk = (Ndim + JAC_BAND_ROWS - 1)/JAC_BAND_ROWS;
+   const TYPE *U = s->A + Ndim, *V = U + (size_t)Ndim*k, *ui, *vi;
+   const TYPE *w  = s->lrw + (it%3)*k;
+   TYPE *wnext    = s->lrw + ((it+1)%3)*k;
+   TYPE wpart[JAC_MAX_RANK];
+   TYPE tmp, conv = (TYPE) 0.0;
+
+   if (lo == 0 && !s->lrparts)
+      memset(s->lrw + ((it+2)%3)*k, 0, k*sizeof(TYPE));
+   for (l=0; l<k; l++) wpart[l] = (TYPE) 0.0;
+   for (i=lo; i<hi; i++){
+      ui      = U + (size_t)i*k;
+      vi      = V + (size_t)i*k;
+      tmp     = s->simd->dot(k, ui, w) - (s->diag[i]-s->A[i])*xold[i];
+      xnew[i] = (b[i]-tmp)*s->dinv[i];
+      #pragma omp simd
+      for (l=0; l<k; l++) wpart[l] += vi[l]*xnew[i];
+      if (check){
+         tmp   = xnew[i]-xold[i];
+         conv += tmp*tmp;
+      }
+   }
+   if (s->lrparts)
+      for (l=0; l<k; l++)
+         s->lrparts[(size_t)l*nblk + lo/JAC_BAND_ROWS] = wpart[l];
+   else
+      for (l=0; l<k; l++){
+         #pragma omp atomic
+         wnext[l] += wpart[l];
+      }
+   return conv;
+}
+
+// w = V^T xnew from the blocks' parts in s->lrparts
+static void jac_lowrank_sum(const jac_solver *s, int nblk, TYPE *w)
+{
+   int  l;
+
+   for (l=0; l<s->rank; l++)
+      w[l] = jac_tree_sum(nblk, s->lrparts + (size_t)l*nblk);
+}
+
+// w = V^T x for the diagonal plus low rank kind
+static void jac_lowrank_vtx(const jac_solver *s, const TYPE *x, TYPE *w)
+{
+   int  i, l, k = s->rank, Ndim = s->Ndim;
+   const TYPE *vi;
+
+   for (l=0; l<k; l++) w[l] = (TYPE) 0.0;
+   for (i=0; i<Ndim; i++){
+      vi = s->A + Ndim + (size_t)Ndim*k + (size_t)i*k;
+      for (l=0; l<k; l++) w[l] += vi[l]*x[i];
+   }
+}
+
+//
+// Balanced CSR (s->balance): chunk c of s->bal.  A piece of a long
+// row only leaves its part of the sum; the thread that does the
+// row's last piece adds the parts up and makes xnew.
+//
+static TYPE jac_csr_chunk(const jac_solver *s, const TYPE *b,
+                          const TYPE *xold, TYPE *xnew, int c, int check)
+{
+   jac_balance *bl = s->bal;
+   int  i, p, left, h = bl->head[c];
+   TYPE sum, tmp, conv = (TYPE) 0.0;
+
+   if (h < 0)
+      return jac_csr_block(s, b, xold, xnew, bl->lo[c], bl->hi[c], check, 0);
+
+   bl->psum[c] = s->simd->dot_gather((int)(bl->k1[c]-bl->k0[c]),
+                                     s->A+bl->k0[c], s->col+bl->k0[c], xold);
+   #pragma omp flush
+   #pragma omp atomic capture
+   left = --bl->left[h];
+   if (left > 0) return conv;
+
+   // the last piece: the other parts are in, and nobody touches
+   // this row again until after the barrier
+   #pragma omp flush
+   bl->left[h] = bl->npieces[h];
+   i   = bl->lo[c];
+   sum = (TYPE) 0.0;
+   for (p=h; p<h+bl->npieces[h]; p++) sum += bl->psum[p];
+   sum -= s->diag[i]*xold[i];
+   xnew[i] = (b[i]-sum)*s->dinv[i];
+   if (check){
+      tmp  = xnew[i]-xold[i];
+      conv = tmp*tmp;
+   }
+   return conv;
+}
+
+//
+// One balanced sweep by the calling thread: its own chunks first,
+// then whatever is left on the other threads' counters
+//
+static TYPE jac_steal_sweep(const jac_solver *s, const TYPE *b,
+                            const TYPE *xold, TYPE *xnew, int it,
+                            int check, jac_thread_stats *st)
+{
+   jac_balance *bl = s->bal;
+   int  n, v, c, nth = bl->nth;
+   int  *next;
+   TYPE conv = (TYPE) 0.0;
+
+   for (n=0; n<nth; n++){
+      v    = (omp_get_thread_num() + n) % nth;
+      next = &JAC_BAL_NEXT(bl, it, v);
+      for (;;){
+         #pragma omp atomic capture
+         c = (*next)++;
+         if (c >= bl->first[v+1]) break;
+         conv += jac_csr_chunk(s, b, xold, xnew, c, check);
+         st->work += bl->k1[c] - bl->k0[c];
+         if (n > 0) st->steals++;
+      }
+   }
+   return conv;
+}
+
+// elements of A in rows lo to hi-1 (for banded, counting the zeros
+// past the corners, and for the structured kinds, the multiply-adds
+// done for them)
+static size_t jac_block_work(const jac_solver *s, int lo, int hi)
+{
+   if (s->storage == JAC_CSR)
+      return s->row_start[hi] - s->row_start[lo];
+   if (s->storage == JAC_GENERATED || s->storage == JAC_TOEPLITZ)
+      return (size_t)(hi-lo)*s->Ndim;
+   if (s->storage == JAC_KRONECKER)
+      return (size_t)(hi-lo)*(s->kp+s->kq);
+   if (s->storage == JAC_LOWRANK)
+      return (size_t)(hi-lo)*2*s->rank;
+   return (size_t)(hi-lo)*(2*s->bw+1);
+}
+
+static void solve_blocks(jac_solver *s, const TYPE *b, TYPE **xresult,
+                         jac_block_fn block)
+{
+   int  Ndim = s->Ndim, max_iters = s->max_iters;
+   int  nth = (s->backend == JAC_SERIAL) ? 1 : omp_get_max_threads();
+   int  rows, nblk, g;
+   TYPE convs[3];
+   TYPE tol2 = s->tolerance*s->tolerance;
+   TYPE *x1 = s->x1, *x2 = s->x2, *parts = NULL;
+   jac_balance *bl = NULL;
+
+   // rows in a block: the dot product sweeps take few rows so their
+   // piece of xold stays in L1, and a Kronecker block is whole rows
+   // of B, at least JAC_KRON_ROWS of them unless that would leave
+   // threads with nothing to do.  Reproducible sums need the blocks
+   // the same for any number of threads, so they keep the full g.
+   if (s->storage == JAC_GENERATED || s->storage == JAC_TOEPLITZ)
+      rows = JAC_BLOCK_ROWS;
+   else if (s->storage == JAC_KRONECKER){
+      g = (JAC_BAND_ROWS/s->kq > JAC_KRON_ROWS) ? JAC_BAND_ROWS/s->kq
+                                                : JAC_KRON_ROWS;
+      if (!s->deterministic && g > s->kp/nth)
+         g = (s->kp/nth > 1) ? s->kp/nth : 1;
+      rows = s->kq*g;
+   }
+   else
+      rows = JAC_BAND_ROWS;
+   nblk = (Ndim + rows - 1)/rows;
+
+   convs[0] = convs[1] = convs[2] = (TYPE) 0.0;
+
+   // the chunks are cut for the number of threads in use.  Which
+   // thread sums which chunk isn't fixed, so reproducible sums
+   // (s->deterministic) take the static split instead.
+   if (s->balance && s->storage == JAC_CSR && !s->deterministic){
+      if (!s->bal || s->bal->nth != nth){
+         jac_balance_destroy(s->bal);
+         s->bal = jac_balance_create(Ndim, s->row_start, nth);
+         if (!s->bal)
+            printf("\n jac_solve: no memory to balance the rows,"
+                   " splitting them evenly\n");
+      }
+      bl = s->bal;
+   }
+   if (bl) jac_balance_reset(bl, 1);
+
+   if (s->ntstats != nth){
+      mm_free(s->tstats);
+      s->tstats  = (jac_thread_stats *) mm_malloc(nth*sizeof(jac_thread_stats));
+      s->ntstats = s->tstats ? nth : 0;
+   }
+   if (s->tstats) memset(s->tstats, 0, nth*sizeof(jac_thread_stats));
+
+   // reproducible sums: conv by block, two iterations' worth as in
+   // solve_par_region_fused, and for low rank each block's part of
+   // V^T xnew
+   mm_free(s->lrparts);
+   s->lrparts = NULL;
+   if (s->deterministic && !bl){
+      parts = (TYPE *) mm_malloc((size_t)2*nblk*sizeof(TYPE));
+      if (parts && s->storage == JAC_LOWRANK){
+         s->lrparts = (TYPE *) mm_malloc((size_t)nblk*s->rank*sizeof(TYPE));
+         if (!s->lrparts){
+            mm_free(parts);
+            parts = NULL;
+         }
+      }
+      if (!parts)
+         printf("\n jac_solve: no memory for reproducible sums\n");
+   }
+
+   // the conv test is fused into the sweep, one barrier per
+   // iteration, as in solve_par_region_fused
+   #pragma omp parallel num_threads(nth) \
+                shared (s, b, rows, nblk, convs, x1, x2, tol2, max_iters, bl, \
+                        parts)
+   {
+   int  blk, lo, hi, it = 0, check;
+   TYPE my_conv, c, conv = (TYPE) LARGE;
+   TYPE *xnew = x1, *xold = x2, *xtmp;
+   jac_check_ctl ctl;
+   jac_thread_stats st;
+   double t0, t1, t2;
+
+   memset(&st, 0, sizeof(st));
+   jac_check_init(&ctl, s);
+   t0 = omp_get_wtime();
+   while((conv > tol2) && (it<max_iters))
+   {
+     it++;
+     xtmp  = xnew;   // every thread swaps its own pointers
+     xnew  = xold;
+     xold  = xtmp;
+
+     check   = jac_check_due(&ctl, it);
+     my_conv = (TYPE) 0.0;
+     if (bl){
+        // the counters for the next iteration were last used in the
+        // one before this, which everyone has finished
+        #pragma omp master
+        jac_balance_reset(bl, it+1);
+
+        my_conv = jac_steal_sweep(s, b, xold, xnew, it, check, &st);
+     }
+     else {
+        #pragma omp for schedule(static) nowait
+        for (blk=0; blk<nblk; blk++){
+           lo = blk*rows;
+           hi = (lo+rows < Ndim) ? lo+rows : Ndim;
+           c  = block(s, b, xold, xnew, lo, hi, check, it);
+           if (parts) parts[(it%2)*nblk + blk] = c;
+           else       my_conv += c;
+           st.work += jac_block_work(s, lo, hi);
+        }
+     }
+     if (check && !parts){
+        #pragma omp atomic
+        convs[it%3] += my_conv;
+     }
+
+     #pragma omp master
+     convs[(it+1)%3] = (TYPE) 0.0;
+
+     t1 = omp_get_wtime();
+     #pragma omp barrier
+     t2 = omp_get_wtime();
+     st.busy += t1 - t0;
+     st.idle += t2 - t1;
+     t0 = t2;
+     if (s->lrparts){
+        // V^T xnew for the next sweep, added up in a fixed order,
+        // at the cost of a second barrier
+        #pragma omp single
+        jac_lowrank_sum(s, nblk, s->lrw + ((it+1)%3)*s->rank);
+     }
+     if (check){
+        conv = parts ? jac_tree_sum(nblk, parts + (it%2)*nblk)
+                     : convs[it%3];
+        jac_check_update(&ctl, it, sqrt((double)conv));
+     }
+   }
+   if (omp_get_thread_num() < s->ntstats)
+      s->tstats[omp_get_thread_num()] = st;
+   #pragma omp master
+   {
+     s->iters  = it;
+     s->conv   = sqrt((double)conv);
+     s->checks = ctl.checks;
+     *xresult  = xnew;
+   }
+   }
+   mm_free(parts);
+}
+
+//
+// The solver's schedule and thread count (see jac_tune.c) are set
+// for the duration of a solve and the caller's put back afterwards.
+//
+typedef struct {
+   omp_sched_t kind;
+   int         chunk;
+   int         nthreads;
+} jac_omp_settings;
+
+static void jac_apply_settings(const jac_solver *s, jac_omp_settings *saved)
+{
+   omp_get_schedule(&saved->kind, &saved->chunk);
+   saved->nthreads = omp_get_max_threads();
+   omp_set_schedule(s->sched_kind ? (omp_sched_t) s->sched_kind
+                                  : omp_sched_static, s->sched_chunk);
+   if (s->nthreads > 0) omp_set_num_threads(s->nthreads);
+}
+
+static void jac_restore_settings(const jac_omp_settings *saved)
+{
+   omp_set_schedule(saved->kind, saved->chunk);
+   omp_set_num_threads(saved->nthreads);
+}
+
+int jac_solve(jac_solver *s, const TYPE *b, TYPE *x)
+{
+   int  i, r, Ndim = s->Ndim;
+   TYPE *xresult = NULL;
+   double start_time;
+   jac_omp_settings saved;
+
+   if (s->backend < 0 || s->backend >= JAC_NUM_BACKENDS){
+      printf("\n jac_solve: unknown backend %d\n", (int)s->backend);
+      return -1;
+   }
+   if (s->backend == JAC_POOL && !s->pool){
+      printf("\n jac_solve: no thread pool, call jac_setup first\n");
+      return -1;
+   }
+
+   // the backends start by swapping x1 and x2, so the initial
+   // guess goes in x1 and x2 is overwritten by the first sweep
+   if (s->perm){
+      for (i=0; i<Ndim; i++){
+         s->x1[i]    = x[s->perm[i]];
+         s->bperm[i] = b[s->perm[i]];
+      }
+      b = s->bperm;
+   }
+   else
+      memcpy(s->x1, x, Ndim*sizeof(TYPE));
+   if (s->xrep)
+      for (r=0; r<s->replicas; r++)
+         memcpy(jac_replica(s, r, s->x1), x, Ndim*sizeof(TYPE));
+
+   jac_apply_settings(s, &saved);
+   start_time = omp_get_wtime();
+   if (s->storage == JAC_PACKED)
+      solve_packed(s, b, &xresult);
+   else if (s->storage == JAC_BANDED)
+      solve_blocks(s, b, &xresult, jac_band_block);
+   else if (s->storage == JAC_CSR)
+      solve_blocks(s, b, &xresult, jac_csr_block);
+   else if (s->storage == JAC_GENERATED)
+      solve_blocks(s, b, &xresult, jac_gen_block);
+   else if (s->storage == JAC_TOEPLITZ)
+      solve_blocks(s, b, &xresult, jac_toep_block);
+   else if (s->storage == JAC_KRONECKER)
+      solve_blocks(s, b, &xresult, jac_kron_block);
+   else if (s->storage == JAC_LOWRANK){
+      // V^T x for the first sweep, and a clear one for it to fill
+      jac_lowrank_vtx(s, s->x1, s->lrw + s->rank);
+      memset(s->lrw + 2*s->rank, 0, s->rank*sizeof(TYPE));
+      solve_blocks(s, b, &xresult, jac_lowrank_block);
+   }
+   else switch (s->backend){
+   case JAC_SERIAL:     solve_serial(s, b, &xresult);     break;
+   case JAC_PAR_FOR:    solve_par_for(s, b, &xresult);    break;
+   case JAC_PAR_REGION:
+      if (s->async) solve_par_region_async(s, b, &xresult);
+      else if (s->speculate) solve_par_region_spec(s, b, &xresult);
+      else if (s->fused) solve_par_region_fused(s, b, &xresult);
+      else          solve_par_region(s, b, &xresult);
+      break;
+   case JAC_TARGET:     solve_target(s, b, &xresult);     break;
+   case JAC_POOL:       solve_pool(s, b, &xresult);       break;
+   case JAC_TASK:       solve_task(s, b, &xresult);       break;
+   default:             break;
+   }
+   s->elapsed_time = omp_get_wtime() - start_time;
+   jac_restore_settings(&saved);
+
+   if (s->perm)
+      for (i=0; i<Ndim; i++) x[s->perm[i]] = xresult[i];
+   else
+      memcpy(x, xresult, Ndim*sizeof(TYPE));
+   return s->iters;
+}
+
+//
+// Multiple right hand sides.  The columns of X are interleaved
+// (X[i*nrhs+k] is row i of column k), so each element of A, once
+// loaded, updates every column from one contiguous row of Xold.
+// A is streamed once per sweep for all the columns instead of once
+// per column; the columns are taken JAC_RHS_CHUNK at a time while a
+// row of A is in cache.  The active columns are kept packed at the front of
+// each row: when a column converges its answer is copied out and
+// the last active column is moved into its place, so the inner
+// loops stay contiguous and only run over the columns still
+// being solved.
+//
+#define JAC_RHS_CHUNK 8   // columns summed together in registers
+
+// sum[k] += a[j]*xold[j][c0+k] for j from lo to hi-1 and k < w
+static void jac_row_multi(const TYPE *a, int lo, int hi, const TYPE *xold,
+                     int nrhs, int c0, int w, TYPE *sum)
+{
+   int  j, k;
+   const TYPE *xr;
+   TYPE dot, acc[JAC_RHS_CHUNK];
+
+   for (k=0; k<JAC_RHS_CHUNK; k++) acc[k] = (TYPE) 0.0;
+   if (c0 + JAC_RHS_CHUNK <= nrhs && w > 1){
+      // fixed trip count, so acc stays in registers.  Columns past
+      // w are retired ones; summing them is cheaper than a short loop
+      for (j=lo; j<hi; j++){
+         xr = xold + (size_t)j*nrhs + c0;
+         #pragma omp simd
+         for (k=0; k<JAC_RHS_CHUNK; k++)
+            acc[k] += a[j]*xr[k];
+      }
+   }
+   else {
+      // a short tail: one strided dot product per column, the row of
+      // A is still in L1 for the second and later ones
+      for (k=0; k<w; k++){
+         xr  = xold + c0 + k;
+         dot = (TYPE) 0.0;
+         #pragma omp simd reduction(+:dot)
+         for (j=lo; j<hi; j++)
+            dot += a[j]*xr[(size_t)j*nrhs];
+         acc[k] = dot;
+      }
+   }
+   for (k=0; k<w; k++) sum[k] += acc[k];
+}
+
+static void jac_sweep_multi(const jac_solver *s, int nrhs, int nact,
+                     const TYPE *B, const TYPE *xold, TYPE *xnew,
+                     TYPE *part)
+{
+   int  i, k, c0, w, Ndim = s->Ndim;
+   size_t ik;
+   const TYPE *a;
+   TYPE d, tmp, sum[JAC_RHS_CHUNK];
+
+   #pragma omp for schedule(runtime)
+   for (i=0; i<Ndim; i++){
+      a = s->A + (size_t)i*Ndim;
+      d = s->split ? s->dinv[i] : (TYPE) 1.0/a[i];
+
+      // the row stays in cache while each chunk of columns uses it
+      for (c0=0; c0<nact; c0+=JAC_RHS_CHUNK){
+         w = (nact-c0 < JAC_RHS_CHUNK) ? nact-c0 : JAC_RHS_CHUNK;
+         for (k=0; k<w; k++) sum[k] = (TYPE) 0.0;
+         if (s->split)
+            jac_row_multi(a, 0, Ndim, xold, nrhs, c0, w, sum);
+         else {
+            jac_row_multi(a, 0, i, xold, nrhs, c0, w, sum);
+            jac_row_multi(a, i+1, Ndim, xold, nrhs, c0, w, sum);
+         }
+         for (k=0; k<w; k++){
+            ik       = (size_t)i*nrhs + c0 + k;
+            xnew[ik] = (B[ik] - sum[k])*d;
+            tmp      = xnew[ik] - xold[ik];
+            part[c0+k] += tmp*tmp;
+         }
+      }
+   }
+}
+
+// copy column k of the nrhs interleaved columns in M to column l
+static void jac_copy_column(int Ndim, int nrhs, TYPE *M, int k, int l)
+{
+   int i;
+   for (i=0; i<Ndim; i++)
+      M[(size_t)i*nrhs+l] = M[(size_t)i*nrhs+k];
+}
+
+int jac_solve_multi(jac_solver *s, int nrhs, const TYPE *B, TYPE *X,
+                    int *iters)
+{
+   int  i, k, t, it = 0, nact = nrhs, nth, Ndim = s->Ndim;
+   size_t NR = (size_t)Ndim*nrhs;
+   TYPE tol2 = s->tolerance*s->tolerance, conv, worst = (TYPE) 0.0;
+   TYPE *xnew, *xold, *xtmp, *Bw, *part;
+   int  *col;
+   double start_time;
+   jac_omp_settings saved;
+
+   if (s->storage != JAC_DENSE){
+      printf("\n jac_solve_multi: only available for dense storage\n");
+      return -1;
+   }
+   jac_apply_settings(s, &saved);
+   nth  = omp_get_max_threads();
+   xnew = (TYPE *) mm_malloc(NR*sizeof(TYPE));
+   xold = (TYPE *) mm_malloc(NR*sizeof(TYPE));
+   Bw   = (TYPE *) mm_malloc(NR*sizeof(TYPE));
+   part = (TYPE *) malloc((size_t)nth*nrhs*sizeof(TYPE));
+   col  = (int *)  malloc(nrhs*sizeof(int));
+   if (!xnew || !xold || !Bw || !part || !col){
+      printf("\n jac_solve_multi: memory allocation error\n");
+      mm_free(xnew); mm_free(xold); mm_free(Bw); free(part); free(col);
+      jac_restore_settings(&saved);
+      return -1;
+   }
+   mm_first_touch(Ndim, nrhs, xnew);
+   mm_first_touch(Ndim, nrhs, xold);
+   memcpy(xnew, X, NR*sizeof(TYPE));
+   memcpy(Bw, B, NR*sizeof(TYPE));
+   for (k=0; k<nrhs; k++) col[k] = k;   // col[k]: which column is in slot k
+
+   start_time = omp_get_wtime();
+   while (nact > 0 && it < s->max_iters)
+   {
+     it++;
+     xtmp  = xnew;   // don't copy arrays.
+     xnew  = xold;   // just swap pointers.
+     xold  = xtmp;
+
+     memset(part, 0, (size_t)nth*nrhs*sizeof(TYPE));
+     #pragma omp parallel shared(s, nrhs, nact, Bw, xold, xnew, part)
+     jac_sweep_multi(s, nrhs, nact, Bw, xold, xnew,
+                     part + (size_t)omp_get_thread_num()*nrhs);
+
+     // retire the columns that have converged
+     for (k=nact-1; k>=0; k--){
+        conv = (TYPE) 0.0;
+        for (t=0; t<nth; t++) conv += part[(size_t)t*nrhs+k];
+        if (conv > tol2 && it < s->max_iters) continue;
+
+        for (i=0; i<Ndim; i++)
+           X[(size_t)i*nrhs+col[k]] = xnew[(size_t)i*nrhs+k];
+        if (iters) iters[col[k]] = it;
+        if (conv > worst) worst = conv;
+
+        nact--;
+        if (k != nact){
+           jac_copy_column(Ndim, nrhs, xnew, nact, k);
+           jac_copy_column(Ndim, nrhs, Bw, nact, k);
+           col[k] = col[nact];
+           for (t=0; t<nth; t++)
+              part[(size_t)t*nrhs+k] = part[(size_t)t*nrhs+nact];
+        }
+     }
+   }
+   s->elapsed_time = omp_get_wtime() - start_time;
+   s->iters  = it;
+   s->checks = it;
+   s->conv   = (TYPE) sqrt((double)worst);
+
+   mm_free(xnew); mm_free(xold); mm_free(Bw); free(part); free(col);
+   jac_restore_settings(&saved);
+   return it;
+}
+
+//
+// Reverse Cuthill-McKee renumbering for CSR storage.  A second call
+// reorders the already reordered matrix, so the new permutation is
+// composed with the old one.
+//
+int jac_reorder(jac_solver *s)
+{
+   int  i, Ndim = s->Ndim, *p;
+   double start = omp_get_wtime();
+
+   if (s->storage != JAC_CSR){
+      printf("\n jac_reorder: only available for CSR storage\n");
+      return -1;
+   }
+   p = (int *) malloc(Ndim*sizeof(int));
+   if (!s->perm){
+      s->perm  = (int *) mm_malloc(Ndim*sizeof(int));
+      s->bperm = (TYPE *) mm_malloc(Ndim*sizeof(TYPE));
+      if (s->perm)
+         for (i=0; i<Ndim; i++) s->perm[i] = i;
+   }
+   if (!p || !s->perm || !s->bperm ||
+       jac_rcm(Ndim, s->row_start, s->col, p) ||
+       jac_csr_permute(Ndim, p, s->row_start, s->col, s->A)){
+      printf("\n jac_reorder: memory allocation error\n");
+      free(p);
+      return -1;
+   }
+
+   // row i is row p[i] of the last order, which was row perm[p[i]]
+   // of the system
+   for (i=0; i<Ndim; i++) p[i] = s->perm[p[i]];
+   memcpy(s->perm, p, Ndim*sizeof(int));
+   free(p);
+
+   s->reorder_time = omp_get_wtime() - start;
+   return 0;
+}
+
+//
+// test answer by multiplying the computed value of x by the
+// input A matrix and comparing the result with the input b vector.
+//
+TYPE jac_residual(const jac_solver *s, const TYPE *b, const TYPE *x,
+                  TYPE *chksum)
+{
+   int  i, j, jlo, jhi, i1, i2, j1, j2, Ndim = s->Ndim, bw = s->bw;
+   int  p = s->kp, q = s->kq;
+   int  nvec = (s->perm ? 3 : 1) + (s->storage == JAC_KRONECKER);
+   unsigned key;
+   const TYPE *a;
+   TYPE w[JAC_MAX_RANK];
+   TYPE err, sum = (TYPE) 0.0, *z;
+   TYPE *Ax = (TYPE *) mm_malloc(nvec*(size_t)Ndim*sizeof(TYPE));
+
+   if (!Ax){
+      printf("\n jac_residual: memory allocation error\n");
+      return (TYPE) LARGE;
+   }
+   if (s->perm){
+      // b and x into the order of the reordered A
+      for(i=0;i<Ndim;i++){
+         Ax[Ndim+i]   = b[s->perm[i]];
+         Ax[2*Ndim+i] = x[s->perm[i]];
+      }
+      b = Ax + Ndim;
+      x = Ax + 2*Ndim;
+   }
+   if (s->storage == JAC_PACKED){
+      // each stored element does (i,j) and (j,i)
+      memset(Ax, 0, Ndim*sizeof(TYPE));
+      for(i=0;i<Ndim;i++){
+         a = s->A + PACKED_INDEX(Ndim, i, i);
+         Ax[i] += a[0]*x[i];
+         for(j=i+1;j<Ndim;j++){
+            Ax[i] += a[j-i]*x[j];
+            Ax[j] += a[j-i]*x[i];
+         }
+         sum += x[i];
+      }
+   }
+   else if (s->storage == JAC_CSR)
+      for(i=0;i<Ndim;i++){
+         Ax[i] = s->simd->dot_gather(
+                    (int)(s->row_start[i+1]-s->row_start[i]),
+                    s->A + s->row_start[i], s->col + s->row_start[i], x);
+         sum += x[i];
+      }
+   else if (s->storage == JAC_GENERATED){
+      // one sweep's worth of hashing, so in parallel
+      #pragma omp parallel for private(key) reduction(+:sum)
+      for(i=0;i<Ndim;i++){
+         key   = MM_HASH_ROW(s->seed, i);
+         Ax[i] = (s->simd->dot_hash(Ndim, key, x)
+                  - MM_HASH_ELEM(key, i)*x[i])*s->gscale[i]
+               + s->diag[i]*x[i];
+         sum  += x[i];
+      }
+   }
+   else if (s->storage == JAC_TOEPLITZ){
+      #pragma omp parallel for reduction(+:sum)
+      for(i=0;i<Ndim;i++){
+         Ax[i] = s->simd->dot(Ndim, s->A + TOEP_INDEX(Ndim, i, 0), x);
+         sum  += x[i];
+      }
+   }
+   else if (s->storage == JAC_KRONECKER){
+      // with x as a p by q matrix X, Ax is B X C^T: Z = B X first
+      z = Ax + (nvec-1)*(size_t)Ndim;
+      memset(z, 0, Ndim*sizeof(TYPE));
+      for(i1=0;i1<p;i1++)
+         for(j1=0;j1<p;j1++)
+            for(j2=0;j2<q;j2++)
+               z[i1*q+j2] += s->A[(size_t)i1*p + j1]*x[j1*q+j2];
+      for(i1=0;i1<p;i1++)
+         for(i2=0;i2<q;i2++){
+            i = i1*q + i2;
+            Ax[i] = s->simd->dot(q, s->A + (size_t)p*p + (size_t)i2*q,
+                                 z + i1*q);
+            sum  += x[i];
+         }
+   }
+   else if (s->storage == JAC_LOWRANK){
+      jac_lowrank_vtx(s, x, w);
+      for(i=0;i<Ndim;i++){
+         Ax[i] = s->A[i]*x[i]
+               + s->simd->dot(s->rank, s->A + Ndim + (size_t)i*s->rank, w);
+         sum  += x[i];
+      }
+   }
+   else if (s->storage == JAC_BANDED)
+      for(i=0;i<Ndim;i++){
+         jlo = (i-bw > 0) ? i-bw : 0;
+         jhi = (i+bw < Ndim-1) ? i+bw : Ndim-1;
+         Ax[i] = (TYPE) 0.0;
+         for(j=jlo;j<=jhi;j++)
+            Ax[i] += s->A[BAND_INDEX(Ndim, bw, i, j)]*x[j];
+         sum += x[i];
+      }
+   else
+      for(i=0;i<Ndim;i++){
+         Ax[i] = s->simd->dot(Ndim, s->A + (size_t)i*Ndim, x);
+         if (s->split) Ax[i] += s->diag[i]*x[i];
+         sum += x[i];
+      }
+   if (s->deterministic){
+      // same fixed order as conv, whatever the vector length
+      for(i=0;i<Ndim;i++)
+         Ax[i] = (Ax[i]-b[i])*(Ax[i]-b[i]);
+      err = jac_tree_sum(Ndim, Ax);
+      sum = jac_tree_sum(Ndim, x);
+   }
+   else
+      err = s->simd->sqdiff(Ndim, Ax, b);
+   mm_free(Ax);
+
+   if (chksum) *chksum = sum;
+   return (TYPE) sqrt((double)err);
+}
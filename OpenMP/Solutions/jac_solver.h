@@ -0,0 +1,355 @@
+//
+// A reentrant Jacobi solver.  The sweep, convergence test and
+// verification from the jac_solv programs are packaged up behind
+// a solver object so the matrix and work vectors are allocated
+// once and the same system can be solved many times.
+//
+// Typical use:
+//
+//    jac_solver *s = jac_create(Ndim, JAC_PAR_REGION);
+//    init_diag_dom_near_identity_matrix(Ndim, s->A);
+//    jac_setup(s);
+//    for (each right hand side b)
+//        jac_solve(s, b, x);        // x holds the initial guess
+//    jac_destroy(s);
+//
+// All state lives in the solver object, so independent solvers
+// can be used from different threads.
+//
+#ifndef JAC_SOLVER_H
+#define JAC_SOLVER_H
+
+#include "mm_utils.h"
+#include "jac_simd.h"
+#include "jac_pool.h"
+#include "jac_balance.h"
+
+#define JAC_TOLERANCE 0.001
+#define JAC_MAX_ITERS 5000
+
+// longest gap between convergence tests when the interval adapts
+#define JAC_MAX_CHECK_INTERVAL 64
+
+// block sizes for JAC_KERNEL_BLOCKED.  JAC_BLOCK_COLS elements of
+// xold (4 KB of doubles) stay in L1 while JAC_BLOCK_ROWS rows use them.
+#define JAC_BLOCK_ROWS 16
+#define JAC_BLOCK_COLS 512
+
+// rows per block of the banded and CSR sweeps; for banded storage
+// their sums (4 KB of doubles) stay in L1 while each diagonal adds
+// to them
+#define JAC_BAND_ROWS 512
+
+// columns of a matrix-free A that a block of JAC_BLOCK_ROWS rows
+// sweeps at a time, so that piece of xold (16 KB of doubles) is read
+// from L1 by every row of the block
+#define JAC_GEN_COLS 2048
+
+// rows of B a Kronecker block takes (at least), so each tile of
+// xold read serves them all, and the size of their tile of B*xold
+// (32 KB of doubles)
+#define JAC_KRON_ROWS 8
+#define JAC_KRON_TILE 4096
+
+// columns of B*xold in a tile.  Fixed, so the order of the sums
+// doesn't change with the rows in a block; the blocks are sized so
+// their rows' tiles still fit in JAC_KRON_TILE.
+#define JAC_KRON_COLS (JAC_KRON_TILE/JAC_KRON_ROWS)
+
+// largest k for a diagonal plus rank k A (jac_create_lowrank)
+#define JAC_MAX_RANK 64
+
+//
+// How the sweep is parallelized.  These match the programs in this
+// directory:
+//    JAC_SERIAL      ... jac_solv.c
+//    JAC_PAR_FOR     ... jac_solv_parfor.c (parallel for per loop)
+//    JAC_PAR_REGION  ... jac_solv_par_for.c (one parallel region)
+//    JAC_TARGET      ... jac_solv_par_dat_reg.c (target + data region)
+//    JAC_POOL        ... long lived pthreads (jac_pool.c) that meet at
+//                        one spinning barrier per iteration
+//    JAC_TASK        ... one task per row block, ordered by depend
+//                        clauses so there is no barrier between sweeps
+//
+typedef enum {
+   JAC_SERIAL = 0,
+   JAC_PAR_FOR,
+   JAC_PAR_REGION,
+   JAC_TARGET,
+   JAC_POOL,
+   JAC_TASK,
+   JAC_NUM_BACKENDS
+} jac_backend;
+
+//
+// How each row of the sweep is computed:
+//    JAC_KERNEL_BRANCHY ... skip j==i inside the loop and divide by
+//                           A[i][i], as in jac_solv.c
+//    JAC_KERNEL_SPLIT   ... jac_setup() moves the diagonal out of A,
+//                           so the row is a branch-free dot product
+//                           times a precomputed 1/A[i][i]
+//    JAC_KERNEL_BLOCKED ... split storage, swept JAC_BLOCK_ROWS rows by
+//                           JAC_BLOCK_COLS columns at a time with four
+//                           rows sharing each load of xold
+//    JAC_KERNEL_SIMD    ... split storage with the hand vectorized
+//                           dot product from jac_simd.c, using the
+//                           widest instruction set the CPU supports
+//
+typedef enum {
+   JAC_KERNEL_BRANCHY = 0,
+   JAC_KERNEL_SPLIT,
+   JAC_KERNEL_BLOCKED,
+   JAC_KERNEL_SIMD,
+   JAC_NUM_KERNELS
+} jac_kernel;
+
+//
+// How A is stored:
+//    JAC_DENSE   ... Ndim by Ndim, row major (jac_create)
+//    JAC_PACKED  ... upper triangle of a symmetric A (jac_create_packed)
+//    JAC_BANDED  ... the diagonals of a banded A (jac_create_banded)
+//    JAC_CSR     ... the nonzeros of a sparse A, row by row
+//                    (jac_create_csr)
+//    JAC_GENERATED . nothing: the elements are made from a hash
+//                    each time they are needed (jac_create_generated)
+//    JAC_TOEPLITZ .. the 2*Ndim-1 diagonals of a Toeplitz (or
+//                    circulant) A (jac_create_toeplitz)
+//    JAC_KRONECKER . the two small factors of A = B (x) C
+//                    (jac_create_kronecker)
+//    JAC_LOWRANK ... the diagonal D and the Ndim by k factors of
+//                    A = D + U*V^T (jac_create_lowrank)
+//
+typedef enum {
+   JAC_DENSE = 0,
+   JAC_PACKED,
+   JAC_BANDED,
+   JAC_CSR,
+   JAC_GENERATED,
+   JAC_TOEPLITZ,
+   JAC_KRONECKER,
+   JAC_LOWRANK
+} jac_storage;
+
+// What one thread did in the last jac_solve() of a banded or CSR
+// solver, summed over the iterations
+typedef struct {
+   size_t       work;          // elements of A swept
+   int          steals;        // chunks taken from other threads
+   double       busy;          // seconds sweeping
+   double       idle;          // seconds waiting at the barrier
+} jac_thread_stats;
+
+typedef struct {
+   int          Ndim;          // A[Ndim][Ndim]
+   jac_storage  storage;
+   int          bw;            // JAC_BANDED: diagonals each side of
+                               // the main one
+   unsigned     seed;          // JAC_GENERATED: which matrix
+   int          kp, kq;        // JAC_KRONECKER: B is kp by kp and C
+                               // kq by kq, Ndim = kp*kq
+   int          rank;          // JAC_LOWRANK: k, the columns of U, V
+   jac_backend  backend;
+   TYPE         tolerance;     // stop when ||xnew-xold|| <= tolerance
+   int          max_iters;
+   int          fused;         // compute conv during the sweep (one pass)
+   int          check_every;   // test convergence every k iterations,
+                               // 0 to adapt k to the convergence rate
+   int          async;         // JAC_PAR_REGION only: 0 for the usual
+                               // synchronous sweeps, n > 0 to sweep
+                               // without barriers, no thread more than
+                               // n iterations ahead of the slowest
+   int          speculate;     // JAC_PAR_REGION only: start the next
+                               // sweep before the convergence sum is
+                               // in, dropping it if it was not needed
+   int          deterministic; // sum conv, err and chksum in a fixed
+                               // order, so results don't change with
+                               // the number of threads
+   jac_kernel   kernel;        // set before calling jac_setup()
+   int          mixed;         // sweep with a float copy of A, keeping
+                               // x and the sums in TYPE (set before
+                               // jac_setup)
+   int          quant;         // 8 or 16 to sweep with A quantized to
+                               // that many bits, 0 for off (set
+                               // before jac_setup)
+   int          balance;       // JAC_CSR only: split the rows over the
+                               // threads by nonzeros, not rows, and
+                               // let threads steal each other's work
+                               // (see jac_balance.h)
+   int          nthreads;      // threads to use, 0 for the OpenMP default
+   int          sched_kind;    // omp_sched_t for the row block loops,
+   int          sched_chunk;   // 0 for schedule(static); see jac_tune.h
+
+   TYPE        *A;             // filled in by the caller, then jac_setup()
+   size_t      *row_start;     // JAC_CSR: where each row starts in A,
+   int         *col;           // Ndim+1 of them, and the column of
+                               // each element of A
+   int         *perm;          // JAC_CSR after jac_reorder(): row i of
+                               // A is row perm[i] of the system
+   TYPE        *bperm;         // b in that order
+   double       reorder_time;  // seconds the last jac_reorder() took
+   float       *Af;            // float copy of A when mixed is set
+   void        *Aq;            // quantized off-diagonal part of A and
+   TYPE        *qscale;        // the scale of each row, when quant is set
+   TYPE        *x1, *x2;       // work vectors, swapped each iteration
+   TYPE        *diag, *dinv;   // diagonal of A and its inverse
+   TYPE        *gscale;        // JAC_GENERATED: 1 over each row's
+                               // sum of raw hashed elements
+   TYPE        *lrw;           // JAC_LOWRANK: V^T x for three
+                               // iterations in turn
+   TYPE        *lrparts;       // ... and with deterministic set, each
+                               // block's part of V^T xnew
+   int          split;         // A holds only the off-diagonal part
+   int          block_rows;    // rows per unit of work in the backends
+   const char  *simd_path;     // simd kernel: path to use, NULL for best
+   const jac_simd_kernels *simd;  // kernels chosen by jac_setup()
+   int          replicas;      // copies of xold, e.g. one per socket
+   TYPE        *xrep;          // the copies, 2*replicas vectors
+   int          on_device;     // A has been mapped to the target device
+   jac_pool    *pool;          // worker threads for JAC_POOL
+   TYPE        *parts;         // per-block parts of conv (deterministic)
+   jac_balance *bal;           // the chunks, when balance is set
+
+   // results from the last call to jac_solve()
+   int          iters;
+   int          checks;        // number of convergence tests made
+   TYPE         conv;
+   double       elapsed_time;
+   jac_thread_stats *tstats;   // banded and CSR: one per thread,
+   int          ntstats;       // for this many threads
+} jac_solver;
+
+// Allocate a solver for an Ndim by Ndim system.  Returns NULL if
+// memory could not be allocated.
+jac_solver *jac_create(int Ndim, jac_backend backend);
+
+// Allocate a solver for a symmetric system with only the upper
+// triangle of A stored, row by row (PACKED_INDEX in mm_utils.h), in
+// half the memory; init_spd_packed_matrix() fills it in.  The sweep
+// reads each stored element once for both of its rows.  It has its
+// own parallel sweep, so the backend only picks serial or parallel
+// and the kernel, fused, async and the like are ignored, as are
+// mixed and quant.  jac_solve_multi() is not available.
+jac_solver *jac_create_packed(int Ndim, jac_backend backend);
+
+// Allocate a solver for a banded A with bw diagonals each side of
+// the main one, stored by diagonals (BAND_INDEX in mm_utils.h) in
+// (2*bw+1)*Ndim elements; init_banded_near_identity_matrix() fills
+// it in.  As with packed storage it has its own parallel sweep and
+// the backend only picks serial or parallel; the kernel matters only
+// in that JAC_KERNEL_SIMD adds up each diagonal with the hand
+// vectorized code from jac_simd.c.  A bw of Ndim or more is cut to
+// Ndim-1.
+jac_solver *jac_create_banded(int Ndim, int bw, jac_backend backend);
+
+// Allocate a solver for a sparse A with nnz nonzeros in compressed
+// sparse row form: the caller fills in s->row_start, s->col and s->A
+// (init_sparse_near_identity_matrix() does), with the diagonal
+// element present in every row.  It sweeps like the banded solver,
+// and JAC_KERNEL_SIMD gathers xold with vector instructions.  Set
+// s->balance when the row lengths vary a lot.
+jac_solver *jac_create_csr(int Ndim, size_t nnz, jac_backend backend);
+
+// Allocate a matrix-free solver for the Ndim by Ndim matrix made
+// from seed by MM_HASH_ROW and MM_HASH_ELEM (mm_utils.h), the same
+// kind of matrix as init_diag_dom_near_identity_matrix().  A is
+// never stored: each sweep works its elements out again from the
+// hash, so the sweep does arithmetic instead of streaming Ndim*Ndim
+// elements from memory, and only vectors of Ndim take memory.
+// jac_setup() works out the row sums, one sweep's worth of work.  As
+// with banded storage the backend only picks serial or parallel and
+// JAC_KERNEL_SIMD makes the elements with vector instructions.
+// init_hashed_diag_dom_matrix() stores the same matrix for a dense
+// solver, for comparison.
+jac_solver *jac_create_generated(int Ndim, unsigned seed,
+                                 jac_backend backend);
+
+// Structured matrices, held in O(Ndim) (or less) memory and swept
+// with kernels that work from the structure.  Like banded storage
+// they have their own parallel sweeps, the backend only picks
+// serial or parallel, and JAC_KERNEL_SIMD picks the hand vectorized
+// dot products.
+//
+// Toeplitz: A[i][j] depends only on j-i and is s->A[TOEP_INDEX(
+// Ndim,i,j)] (mm_utils.h), 2*Ndim-1 elements; a circulant A is
+// stored the same way (init_circulant_matrix() does this).  Each
+// row is a dot product with a window of s->A that slides by one
+// from row to row, so the sweep runs from cache.
+jac_solver *jac_create_toeplitz(int Ndim, jac_backend backend);
+
+// Kronecker product A = B (x) C, A[i1*kq+i2][j1*kq+j2] =
+// B[i1][j1]*C[i2][j2], of order kp*kq.  s->A holds B (kp by kp,
+// row major) then C (kq by kq).  The sweep forms A*x as B*X*C^T
+// with X the kp by kq matrix x, O(Ndim*(kp+kq)) work per sweep.
+jac_solver *jac_create_kronecker(int kp, int kq, jac_backend backend);
+
+// Diagonal plus rank k, A = D + U*V^T with U and V Ndim by k.  s->A
+// holds D (Ndim), then U and then V, row major.  Each sweep uses
+// w = V^T*xold, k numbers, and makes the next one from xnew as it
+// goes, so it is O(Ndim*k) with one barrier per iteration as for
+// the other sweeps.  Returns NULL if k is not 1 to JAC_MAX_RANK.
+jac_solver *jac_create_lowrank(int Ndim, int k, jac_backend backend);
+
+// Renumber the unknowns of a CSR solver in reverse Cuthill-McKee
+// order (see jac_rcm.h), so the nonzeros of each row sit near the
+// diagonal and the xold each sweep gathers comes from a few cache
+// lines.  Call after A is filled in and before jac_setup().  From
+// then on jac_solve() and jac_residual() take b and x in the
+// original order and reorder them on the way in and out.  The time
+// it took is left in s->reorder_time.  Returns 0, or -1 if s isn't
+// a CSR solver or memory could not be allocated.
+int jac_reorder(jac_solver *s);
+
+void jac_destroy(jac_solver *s);
+
+// Must be called after A is filled in (or changed), or the kernel
+// is changed, and before the next call to jac_solve().  For split
+// kernels this moves the diagonal of A into s->diag.  A may be
+// filled in again while split; the next jac_setup() sees the new
+// diagonal whichever kernel is set.  With s->mixed
+// set it also makes the float copy of A that the sweeps read, which
+// halves the bytes per sweep.  The blocked kernel then runs as the
+// split one, and the target backend and jac_solve_multi() still use
+// A; jac_residual() always does, so it measures the error of the
+// mixed precision answer against the full precision system.
+//
+// With s->quant set (which wins over mixed) the off-diagonal part of
+// A is stored as 8 or 16 bit integers times one scale per row, and
+// the diagonal is kept in full precision in s->diag and s->dinv.
+// The scale is the largest element over 127 (or 32767), unless the
+// row's elements are all whole multiples of its smallest one, as
+// they are from the mm_utils generators, and then it is that
+// element and the row is stored exactly.  Every kernel sweeps
+// with split storage, the blocked one as the split one.
+void jac_setup(jac_solver *s);
+
+// Solve Ax=b.  On input x is the initial guess, on output it is
+// the solution.  Returns the number of iterations.
+int jac_solve(jac_solver *s, const TYPE *b, TYPE *x);
+
+// Solve AX=B for nrhs right hand sides at once, reading A once per
+// sweep for all of them.  B and X are Ndim by nrhs with the columns
+// interleaved: element i of column k is at [i*nrhs+k].  On input X
+// holds the initial guesses.  Each column stops when it converges;
+// if iters is not NULL, iters[k] gets the iterations column k took.
+// Uses the sweep of the kernel set up in s (split or not) on every
+// backend.  Returns the largest number of iterations.
+int jac_solve_multi(jac_solver *s, int nrhs, const TYPE *B, TYPE *X,
+                    int *iters);
+
+// Return ||Ax-b|| and, if chksum is not NULL, the sum of the
+// elements of x.
+TYPE jac_residual(const jac_solver *s, const TYPE *b, const TYPE *x,
+                  TYPE *chksum);
+
+const char *jac_backend_name(jac_backend backend);
+const char *jac_backend_short_name(jac_backend backend);
+const char *jac_kernel_name(jac_kernel kernel);
+
+// Look up a backend by the names returned by jac_backend_name() or
+// the short names serial, parfor, region, target, pool and
+// task.  Returns -1
+// for an unknown name.
+int jac_backend_from_name(const char *name);
+int jac_kernel_from_name(const char *name);
+
+#endif
@@ -0,0 +1,240 @@
+//
+// Autotuning and saved profiles for the Jacobi solver.  See jac_tune.h.
+//
+// A profile file has one line per tuned case:
+//
+//    host ndim storage backend kernel bind threads schedule chunk time
+//
+// for example
+//
+//    node07 2000 dense region blocked close 8 dynamic 4 0.00031
+//    node07 1000000 banded:3 region branchy close 8 static 0 0.0021
+//
+// where time is seconds per sweep.  The storage has the shape that
+// sets the cost of a row after the colon: half bandwidth, nonzeros
+// per row, Kronecker factor B's order or rank.
+//
+#include <string.h>
+#include <unistd.h>
+#include "jac_tune.h"
+
+#define JAC_TUNE_LINE 512
+
+static const char *sched_names[] = {"default", "static", "dynamic", "guided"};
+
+static const int tune_kinds[]  = {omp_sched_static, omp_sched_dynamic,
+                                  omp_sched_guided};
+static const int tune_chunks[] = {0, 1, 4, 16, 64};
+
+const char *jac_sched_name(int kind)
+{
+   if (kind < 0 || kind > 3) return "unknown";
+   return sched_names[kind];
+}
+
+static int jac_sched_from_name(const char *name)
+{
+   int i;
+   for (i=0; i<4; i++)
+      if (!strcmp(name, sched_names[i])) return i;
+   return -1;
+}
+
+static const char *jac_bind_name(void)
+{
+   switch (omp_get_proc_bind()){
+   case omp_proc_bind_false:  return "false";
+   case omp_proc_bind_true:   return "true";
+   case omp_proc_bind_master: return "master";
+   case omp_proc_bind_close:  return "close";
+   case omp_proc_bind_spread: return "spread";
+   default:                   return "unknown";
+   }
+}
+
+static void jac_host_name(char *host, int len)
+{
+   if (gethostname(host, len) != 0) strcpy(host, "unknown");
+   host[len-1] = '\0';
+}
+
+// the storage field of the key
+static void jac_storage_key(const jac_solver *s, char *key, int len)
+{
+   static const char *names[] = {"dense", "packed", "banded", "csr",
+                                 "generated", "toeplitz", "kronecker",
+                                 "lowrank"};
+   int  shape = -1;
+
+   if (s->storage == JAC_BANDED)    shape = s->bw;
+   if (s->storage == JAC_CSR)       shape = (int)(s->row_start[s->Ndim]/s->Ndim);
+   if (s->storage == JAC_KRONECKER) shape = s->kp;
+   if (s->storage == JAC_LOWRANK)   shape = s->rank;
+   if (shape < 0) snprintf(key, len, "%s", names[s->storage]);
+   else           snprintf(key, len, "%s:%d", names[s->storage], shape);
+}
+
+// time JAC_TUNE_ITERS sweeps with the settings now in s
+static double jac_tune_trial(jac_solver *s, const TYPE *b, TYPE *x)
+{
+   int i;
+   if (s->backend == JAC_POOL) jac_setup(s);   // pool size may change
+   for (i=0; i<s->Ndim; i++) x[i] = (TYPE) 0.0;
+   if (jac_solve(s, b, x) <= 0) return BIG;
+   return s->elapsed_time/s->iters;
+}
+
+double jac_tune(jac_solver *s, const TYPE *b, int verbose)
+{
+   int    k, c, nk, nc, t, tmax = omp_get_max_threads();
+   int    max_iters = s->max_iters, check_every = s->check_every;
+   int    best_t, best_kind, best_chunk;
+   TYPE   tolerance = s->tolerance;
+   double time, best = BIG;
+   TYPE  *x = (TYPE *) malloc(s->Ndim*sizeof(TYPE));
+
+   if (!x){
+      printf("\n jac_tune: memory allocation error\n");
+      return BIG;
+   }
+
+   // run exactly JAC_TUNE_ITERS sweeps per trial
+   s->max_iters   = JAC_TUNE_ITERS;
+   s->tolerance   = (TYPE) 0.0;
+   s->check_every = 1;
+
+   // only the parfor and region backends have loops to schedule
+   nk = nc = 1;
+   if (s->backend == JAC_PAR_FOR || s->backend == JAC_PAR_REGION){
+      nk = sizeof(tune_kinds)/sizeof(tune_kinds[0]);
+      nc = sizeof(tune_chunks)/sizeof(tune_chunks[0]);
+   }
+   best_t = tmax;  best_kind = best_chunk = 0;
+
+   // thread counts 1, 2, 4, ... and all of them
+   for (t=1; ; t = (2*t < tmax) ? 2*t : tmax){
+      for (k=0; k<nk; k++){
+         for (c=0; c<nc; c++){
+            s->nthreads    = (s->backend == JAC_SERIAL) ? 0 : t;
+            s->sched_kind  = (nk > 1) ? tune_kinds[k] : 0;
+            s->sched_chunk = (nk > 1) ? tune_chunks[c] : 0;
+            time = jac_tune_trial(s, b, x);
+            if (verbose)
+               printf(" tune: %2d threads schedule(%s,%d) %g s/sweep\n",
+                      t, jac_sched_name(s->sched_kind), s->sched_chunk, time);
+            if (time < best){
+               best = time;
+               best_t = s->nthreads;  best_kind = s->sched_kind;
+               best_chunk = s->sched_chunk;
+            }
+         }
+      }
+      if (t == tmax || s->backend == JAC_SERIAL) break;
+   }
+
+   s->max_iters   = max_iters;
+   s->tolerance   = tolerance;
+   s->check_every = check_every;
+   s->nthreads    = best_t;
+   s->sched_kind  = best_kind;
+   s->sched_chunk = best_chunk;
+   if (s->backend == JAC_POOL) jac_setup(s);
+   free(x);
+   return best;
+}
+
+int jac_profile_load(jac_solver *s, const char *file)
+{
+   char   line[JAC_TUNE_LINE], host[256], h[256], be[32], kn[32];
+   char   bind[32], best_bind[32], sched[32], st[64], key[64];
+   int    n, t, chunk, kind, found = 0, found_here = 0;
+   int    best_t = 0, best_kind = 0, best_chunk = 0;
+   int    here_t = 0, here_kind = 0, here_chunk = 0;
+   double time, best = BIG, best_here = BIG;
+   FILE  *fp = fopen(file, "r");
+
+   if (!fp) return 0;
+   jac_host_name(host, sizeof(host));
+   jac_storage_key(s, key, sizeof(key));
+   while (fgets(line, sizeof(line), fp)){
+      if (sscanf(line, "%255s %d %63s %31s %31s %31s %d %31s %d %lf",
+                 h, &n, st, be, kn, bind, &t, sched, &chunk, &time) != 10)
+         continue;
+      kind = jac_sched_from_name(sched);
+      if (strcmp(h, host) || n != s->Ndim || strcmp(st, key) || kind < 0 ||
+          jac_backend_from_name(be) != (int)s->backend ||
+          jac_kernel_from_name(kn) != (int)s->kernel)
+         continue;
+      if (time < best){
+         best = time;  found = 1;
+         best_t = t;  best_kind = kind;  best_chunk = chunk;
+         strcpy(best_bind, bind);
+      }
+      if (!strcmp(bind, jac_bind_name()) && time < best_here){
+         best_here = time;  found_here = 1;
+         here_t = t;  here_kind = kind;  here_chunk = chunk;
+      }
+   }
+   fclose(fp);
+   if (!found) return 0;
+
+   if (strcmp(best_bind, jac_bind_name()) && found_here)
+      printf(" profile: OMP_PROC_BIND=%s was faster (%g vs %g s/sweep)\n",
+             best_bind, best, best_here);
+   else if (strcmp(best_bind, jac_bind_name()))
+      printf(" profile: tuned with OMP_PROC_BIND=%s, not %s\n",
+             best_bind, jac_bind_name());
+   // use what was best with the binding we have, if it was tuned
+   if (found_here){
+      best_t = here_t;  best_kind = here_kind;  best_chunk = here_chunk;
+   }
+   s->nthreads    = best_t;
+   s->sched_kind  = best_kind;
+   s->sched_chunk = best_chunk;
+   return 1;
+}
+
+int jac_profile_save(const jac_solver *s, const char *file, double time)
+{
+   char  line[JAC_TUNE_LINE], host[256], h[256], be[32], kn[32], bind[32];
+   char  st[64], key[64], tmpfile[JAC_TUNE_LINE];
+   int   n;
+   FILE *in, *out;
+
+   jac_host_name(host, sizeof(host));
+   jac_storage_key(s, key, sizeof(key));
+   if (strlen(file) + 5 > sizeof(tmpfile)) return -1;
+   sprintf(tmpfile, "%s.tmp", file);
+   out = fopen(tmpfile, "w");
+   if (!out){
+      printf("\n jac_profile_save: can't write %s\n", tmpfile);
+      return -1;
+   }
+
+   // copy the other entries, dropping the one we replace
+   in = fopen(file, "r");
+   if (in){
+      while (fgets(line, sizeof(line), in)){
+         if (sscanf(line, "%255s %d %63s %31s %31s %31s",
+                    h, &n, st, be, kn, bind) == 6 &&
+             !strcmp(h, host) && n == s->Ndim && !strcmp(st, key) &&
+             jac_backend_from_name(be) == (int)s->backend &&
+             jac_kernel_from_name(kn) == (int)s->kernel &&
+             !strcmp(bind, jac_bind_name()))
+            continue;
+         fputs(line, out);
+      }
+      fclose(in);
+   }
+   fprintf(out, "%s %d %s %s %s %s %d %s %d %g\n", host, s->Ndim, key,
+           jac_backend_short_name(s->backend), jac_kernel_name(s->kernel),
+           jac_bind_name(), s->nthreads, jac_sched_name(s->sched_kind),
+           s->sched_chunk, time);
+   fclose(out);
+
+   if (rename(tmpfile, file) != 0){
+      printf("\n jac_profile_save: can't replace %s\n", file);
+      return -1;
+   }
+   return 0;
+}
@@ -0,0 +1,40 @@
+//
+// Tuning the parallel loops of the Jacobi solver.  jac_tune() times
+// a few sweeps with each schedule, chunk size and thread count and
+// leaves the fastest in the solver.  The winners are kept in a
+// profile file, one line per host, Ndim, storage (with its bandwidth,
+// nonzeros per row and so on), backend, kernel and thread binding,
+// so later runs can pick them up with jac_profile_load().
+//
+// Binding can't be changed once the program has started, so the
+// tuner works with the binding in effect (OMP_PROC_BIND).  Tune once
+// per binding and jac_profile_load() picks the best of them, telling
+// you which OMP_PROC_BIND to use if it isn't the current one.
+//
+#ifndef JAC_TUNE_H
+#define JAC_TUNE_H
+
+#include "jac_solver.h"
+
+#define JAC_TUNE_ITERS   50                // sweeps timed per trial
+#define JAC_PROFILE_FILE "jac_tune.prof"   // default profile file
+
+// Search schedules, chunk sizes and thread counts for s, which must
+// be set up (jac_setup) with A filled in, using b as the right hand
+// side.  Leaves the fastest settings in s and returns the time per
+// sweep they gave.
+double jac_tune(jac_solver *s, const TYPE *b, int verbose);
+
+// Apply the best saved settings for this host and s's size, storage,
+// backend and kernel.  Call before jac_setup(), with A filled in.  Returns 1 if settings were
+// found, 0 if not.
+int jac_profile_load(jac_solver *s, const char *file);
+
+// Save the settings in s, with their time per sweep, replacing any
+// earlier entry with the same key.  Returns 0 on success.
+int jac_profile_save(const jac_solver *s, const char *file, double time);
+
+// name of a schedule kind as used in OMP_SCHEDULE ("default" for 0)
+const char *jac_sched_name(int kind);
+
+#endif
@@ -2,7 +2,16 @@
 // This is a set of simple utility routines and test
 // generators for my matrix multiplication test bed.
 //
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE     // for MAP_ANONYMOUS, MAP_HUGETLB and MADV_HUGEPAGE
+#endif
 #include "mm_utils.h"
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
 
 //
 // Compare two matrices ... return the sum of the squares 
@@ -31,6 +40,158 @@ void mm_clear(int Ndim, int Mdim, TYPE *C){
            *(C+i*Mdim+j) = (TYPE) 0.0;
 }
 
+//=========================================================
+// Aligned, huge page backed allocation for the big arrays.
+//
+// mm_malloc returns MM_ALIGN aligned memory (a cache line, and a
+// full AVX-512 vector).  Allocations of at least MM_HUGE_PAGE bytes
+// try, in order,
+//    explicit huge pages   (mmap with MAP_HUGETLB, needs pages
+//                           reserved in /proc/sys/vm/nr_hugepages)
+//    transparent huge pages (huge page aligned, madvise MADV_HUGEPAGE)
+//    ordinary pages
+// and smaller ones just get ordinary aligned pages.  The pages are
+// not touched here, so first touch placement still works.  What was
+// obtained is kept in front of the buffer for mm_free and
+// mm_alloc_report.  Free with mm_free, never with free.
+//=========================================================
+enum { MM_SMALL_PAGES, MM_TRANSPARENT_HUGE_PAGES, MM_EXPLICIT_HUGE_PAGES };
+
+typedef struct {
+   size_t bytes;      // size requested
+   size_t mapped;     // size of the underlying allocation
+   int    kind;
+} mm_header;
+
+void *mm_malloc(size_t bytes){
+   size_t total = bytes + MM_ALIGN;
+   char  *base  = NULL;
+   int    kind  = MM_SMALL_PAGES;
+   mm_header *h;
+
+#if defined(__linux__) && defined(MAP_HUGETLB)
+   if (total >= MM_HUGE_PAGE){
+      size_t len = (total + MM_HUGE_PAGE - 1)/MM_HUGE_PAGE*MM_HUGE_PAGE;
+      void  *p   = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p != MAP_FAILED){
+         base  = (char *) p;
+         total = len;
+         kind  = MM_EXPLICIT_HUGE_PAGES;
+      }
+   }
+#endif
+   if (!base){
+#if defined(_WIN32)
+      base = (char *) _aligned_malloc(total, MM_ALIGN);
+#else
+      size_t align = MM_ALIGN;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      if (total >= MM_HUGE_PAGE) align = MM_HUGE_PAGE;
+#endif
+      if (posix_memalign((void **) &base, align, total)) base = NULL;
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+      if (base && align == MM_HUGE_PAGE &&
+          !madvise(base, total, MADV_HUGEPAGE))
+         kind = MM_TRANSPARENT_HUGE_PAGES;
+#endif
+#endif
+      if (!base) return NULL;
+   }
+
+   h = (mm_header *) base;
+   h->bytes  = bytes;
+   h->mapped = total;
+   h->kind   = kind;
+   return base + MM_ALIGN;
+}
+
+void mm_free(void *p){
+   mm_header *h;
+   if (!p) return;
+   h = (mm_header *) ((char *) p - MM_ALIGN);
+#if defined(__linux__) && defined(MAP_HUGETLB)
+   if (h->kind == MM_EXPLICIT_HUGE_PAGES){
+      munmap(h, h->mapped);
+      return;
+   }
+#endif
+#if defined(_WIN32)
+   _aligned_free(h);
+#else
+   free(h);
+#endif
+}
+
+#if defined(__linux__)
+//
+// KB of the mapping holding p that the kernel has actually backed
+// with transparent huge pages, or -1 if that can't be found out.
+//
+static long mm_thp_kb(const void *p){
+   FILE *f = fopen("/proc/self/smaps", "r");
+   char  line[256];
+   unsigned long lo, hi;
+   long  kb = -1;
+   int   in = 0;
+   if (!f) return -1;
+   while (fgets(line, sizeof(line), f)){
+      if (sscanf(line, "%lx-%lx", &lo, &hi) == 2)
+         in = ((unsigned long) p >= lo && (unsigned long) p < hi);
+      else if (in && sscanf(line, "AnonHugePages: %ld kB", &kb) == 1)
+         break;
+   }
+   fclose(f);
+   return kb;
+}
+#endif
+
+//
+// Print what mm_malloc obtained for buffer p.  Transparent huge pages
+// are only handed out as the pages are touched, so call this after
+// the buffer has been filled in.
+//
+void mm_alloc_report(const char *name, const void *p){
+   static const char *kinds[] = {
+      "ordinary pages", "transparent huge pages", "explicit huge pages"
+   };
+   const mm_header *h;
+   long  kb = -1;
+   if (!p) return;
+   h = (const mm_header *) ((const char *) p - MM_ALIGN);
+   printf(" %s: %.1f MB, %d-byte aligned, %s", name,
+          (double) h->bytes/(1024.0*1024.0), MM_ALIGN, kinds[h->kind]);
+#if defined(__linux__)
+   if (h->kind == MM_TRANSPARENT_HUGE_PAGES) kb = mm_thp_kb(p);
+#endif
+   if (kb >= 0)
+      printf(" (%.1f MB on huge pages)", (double) kb/1024.0);
+   printf("\n");
+}
+
+//
+// Zero a matrix in parallel, rows split over the threads with a
+// static schedule.  Call this right after allocating a matrix (and
+// before filling it in serially) so on a NUMA system each page lands
+// on the socket of the thread that works on those rows later.
+//
+void mm_first_touch(int Ndim, int Mdim, TYPE *C){
+   int i,j;
+   #pragma omp parallel for private(j) schedule(static)
+   for (i=0; i<Ndim; i++)
+       for (j=0; j<Mdim; j++)
+           *(C+(size_t)i*Mdim+j) = (TYPE) 0.0;
+}
+
+// same for a float matrix (A in the mixed precision solvers)
+void mm_first_touch_f(int Ndim, int Mdim, float *C){
+   int i,j;
+   #pragma omp parallel for private(j) schedule(static)
+   for (i=0; i<Ndim; i++)
+       for (j=0; j<Mdim; j++)
+           *(C+(size_t)i*Mdim+j) = 0.0f;
+}
+
 //
 //  Print the elements of a matrix to standard out
 //  (might be useful for debugging).
@@ -201,5 +362,426 @@ void init_diag_dom_near_identity_matrix(int Ndim,  TYPE *A) {
            *(A+i*Ndim+j) /= sum;
     }
 
+}   
+//=========================================================
+// Symmetric positive definite test matrices.  The off-diagonal
+// elements are drawn for the upper triangle, row by row, and
+// mirrored.  As in init_diag_dom_near_identity_matrix each diagonal
+// element is its drawn value plus the sum of the row, so the matrix
+// is symmetric and strictly diagonally dominant with a positive
+// diagonal, and so positive definite.  It is then scaled by one
+// constant (to stay symmetric) so the diagonal averages one.  For
+// the same rand() sequence both give the same matrix.
+//=========================================================
+static void spd_finish(int Ndim, TYPE *d, const TYPE *off)
+{
+    int i;
+    TYPE sum = (TYPE)0.0;
+    for(i=0; i<Ndim; i++){
+       d[i] = d[i] + off[i] + d[i];
+       sum += d[i];
+    }
+    d[Ndim] = Ndim/sum;      // the scale
+}
+
+void init_spd_matrix(int Ndim,  TYPE *A) {
+
+    int i,j;
+    TYPE *d = (TYPE *) malloc((2*Ndim+1)*sizeof(TYPE)), *off = d+Ndim+1;
+
+    if (!d){
+       printf("\n memory allocation error\n");
+       exit(-1);
+    }
+
+    for(i=0; i<Ndim; i++){
+       d[i] = (rand()%23 + 1)/(TYPE)1000.0;
+       for(j=i+1; j<Ndim; j++){
+           *(A+(size_t)i*Ndim+j) = (rand()%23)/(TYPE)1000.0;
+           *(A+(size_t)j*Ndim+i) = *(A+(size_t)i*Ndim+j);
+       }
+    }
+    for(i=0; i<Ndim; i++){
+       off[i] = (TYPE)0.0;
+       for(j=0; j<Ndim; j++)
+           if (j != i) off[i] += *(A+(size_t)i*Ndim+j);
+    }
+    spd_finish(Ndim, d, off);
+    for(i=0; i<Ndim; i++){
+       *(A+(size_t)i*Ndim+i) = d[i];
+       for(j=0; j<Ndim; j++)
+           *(A+(size_t)i*Ndim+j) *= d[Ndim];
+    }
+    free(d);
+}
+
+void init_spd_packed_matrix(int Ndim,  TYPE *Ap) {
+
+    int i,j;
+    size_t k;
+    TYPE *d = (TYPE *) malloc((2*Ndim+1)*sizeof(TYPE)), *off = d+Ndim+1;
+
+    if (!d){
+       printf("\n memory allocation error\n");
+       exit(-1);
+    }
+
+    for(i=0; i<Ndim; i++){
+       d[i] = (rand()%23 + 1)/(TYPE)1000.0;
+       for(j=i+1; j<Ndim; j++)
+           *(Ap+PACKED_INDEX(Ndim,i,j)) = (rand()%23)/(TYPE)1000.0;
+    }
+    // the row sums in the same order as init_spd_matrix
+    for(i=0; i<Ndim; i++){
+       off[i] = (TYPE)0.0;
+       for(j=0; j<Ndim; j++){
+           if (j < i)      off[i] += *(Ap+PACKED_INDEX(Ndim,j,i));
+           else if (j > i) off[i] += *(Ap+PACKED_INDEX(Ndim,i,j));
+       }
+    }
+    spd_finish(Ndim, d, off);
+    for(i=0; i<Ndim; i++){
+       *(Ap+PACKED_INDEX(Ndim,i,i)) = d[i];
+       for(k=PACKED_INDEX(Ndim,i,i); k<PACKED_INDEX(Ndim,i,Ndim); k++)
+           *(Ap+k) *= d[Ndim];
+    }
+    free(d);
+}
+
+//=========================================================
+// Banded version of init_diag_dom_near_identity_matrix, stored by
+// diagonals (BAND_INDEX in mm_utils.h).  Each row draws only the
+// elements inside the band.  With so few of them a row can draw all
+// zeros, so the diagonal is drawn from 1 up rather than 0 up, which
+// keeps every row strictly dominant.
+//=========================================================
+void init_banded_near_identity_matrix(int Ndim, int bw, TYPE *Ab) {
+
+    int i,j,jlo,jhi;
+    TYPE sum;
+
+    for(i=0; i<Ndim; i++){
+       jlo = (i-bw > 0) ? i-bw : 0;
+       jhi = (i+bw < Ndim-1) ? i+bw : Ndim-1;
+       sum = (TYPE)0.0;
+       for(j=i-bw; j<=i+bw; j++){
+           if (j < jlo || j > jhi)
+              *(Ab+BAND_INDEX(Ndim,bw,i,j)) = (TYPE)0.0;
+           else if (j == i)
+              *(Ab+BAND_INDEX(Ndim,bw,i,j)) = (rand()%23 + 1)/(TYPE)1000.0;
+           else
+              *(Ab+BAND_INDEX(Ndim,bw,i,j)) = (rand()%23)/(TYPE)1000.0;
+           sum += *(Ab+BAND_INDEX(Ndim,bw,i,j));
+       }
+       *(Ab+BAND_INDEX(Ndim,bw,i,i)) += sum;
+
+       for(j=jlo; j<=jhi; j++)
+           *(Ab+BAND_INDEX(Ndim,bw,i,j)) /= sum;
+    }
+
+}
+
+//=========================================================
+// Sparse version of init_diag_dom_near_identity_matrix, in CSR
+// form (see mm_utils.h).  The off-diagonal columns of each row are
+// drawn at random, without repeats, and the off-diagonal values from
+// 1 up so each one really is a nonzero.  As in the banded version
+// the diagonal is drawn from 1 up too, so every row is strictly
+// dominant.  The banded flavour draws the columns from a window of
+// 2*bw+1 around the diagonal (shifted to stay inside the matrix).
+//=========================================================
+static int sparse_rand(int n)
+{
+    // RAND_MAX may be as small as 32767
+    return (int)((((size_t)rand() << 15) ^ (size_t)rand()) % n);
+}
+
+static void init_sparse_rows(int Ndim, int nzr, int bw, size_t *row_start,
+                             int *col, TYPE *val) {
+
+    int i,j,k,c,lo,width;
+    size_t r;
+    TYPE sum, v;
+
+    if (nzr > Ndim) nzr = Ndim;
+    width = 2*bw+1;
+    if (width < nzr) width = nzr;
+    if (bw <= 0 || width > Ndim) width = Ndim;
+    for(i=0; i<Ndim; i++){
+       r = (size_t)i*nzr;
+       row_start[i] = r;
+       lo = i - width/2;
+       if (lo > Ndim-width) lo = Ndim-width;
+       if (lo < 0) lo = 0;
+
+       // draw the columns, keeping them sorted by insertion
+       col[r] = i;
+       val[r] = (rand()%23 + 1)/(TYPE)1000.0;
+       for(k=1; k<nzr; k++){
+          do {
+             c = lo + sparse_rand(width);
+             for(j=0; j<k; j++)
+                if (col[r+j] == c) break;
+          } while (j < k);
+          v = (rand()%22 + 1)/(TYPE)1000.0;
+          for(j=k; j>0 && col[r+j-1] > c; j--){
+             col[r+j] = col[r+j-1];
+             val[r+j] = val[r+j-1];
+          }
+          col[r+j] = c;
+          val[r+j] = v;
+       }
+
+       sum = (TYPE)0.0;
+       for(k=0; k<nzr; k++) sum += val[r+k];
+       for(k=0; k<nzr; k++){
+          if (col[r+k] == i) val[r+k] += sum;
+          val[r+k] /= sum;
+       }
+    }
+    row_start[Ndim] = (size_t)Ndim*nzr;
+
+}
+
+void init_sparse_near_identity_matrix(int Ndim, int nzr, size_t *row_start,
+                                      int *col, TYPE *val) {
+    init_sparse_rows(Ndim, nzr, 0, row_start, col, val);
+}
+
+void init_sparse_banded_near_identity_matrix(int Ndim, int nzr, int bw,
+                            size_t *row_start, int *col, TYPE *val) {
+    init_sparse_rows(Ndim, nzr, bw, row_start, col, val);
+}
+
+//=========================================================
+// Sparse rows with a power law spread of lengths: row i has
+// 2 + K/(i+1) nonzeros, at most Ndim, with K set so there are
+// about nzr per row in all.  The columns are drawn at random,
+// marked so none comes up twice, and sorted.
+//=========================================================
+static double powerlaw_scale(int Ndim, int nzr)
+{
+    int i;
+    double h = 0.0;
+
+    for(i=Ndim; i>0; i--) h += 1.0/i;
+    return (nzr - 2)*(double)Ndim/h;
+}
+
+static int powerlaw_len(int Ndim, int nzr, double K, int i)
+{
+    double n;
+
+    if (nzr <= 2) return (nzr < Ndim) ? nzr : Ndim;
+    n = 2.0 + K/(i+1);
+    return (n < Ndim) ? (int)n : Ndim;
+}
+
+static int cmp_col(const void *a, const void *b)
+{
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+size_t mm_powerlaw_nnz(int Ndim, int nzr) {
+
+    int i;
+    size_t nnz = 0;
+    double K = powerlaw_scale(Ndim, nzr);
+
+    for(i=0; i<Ndim; i++) nnz += powerlaw_len(Ndim, nzr, K, i);
+    return nnz;
+}
+
+void init_sparse_powerlaw_matrix(int Ndim, int nzr, size_t *row_start,
+                                 int *col, TYPE *val) {
+
+    int i,k,n,c;
+    size_t r = 0;
+    TYPE sum;
+    double K = powerlaw_scale(Ndim, nzr);
+    char *mark = (char *) calloc(Ndim, 1);
+
+    if (!mark){
+       printf("\n memory allocation error\n");
+       exit(-1);
+    }
+
+    for(i=0; i<Ndim; i++){
+       n = powerlaw_len(Ndim, nzr, K, i);
+       row_start[i] = r;
+       col[r]  = i;
+       mark[i] = 1;
+       for(k=1; k<n; k++){
+          do c = sparse_rand(Ndim); while (mark[c]);
+          mark[c]  = 1;
+          col[r+k] = c;
+       }
+       qsort(col+r, n, sizeof(int), cmp_col);
+
+       sum = (TYPE)0.0;
+       for(k=0; k<n; k++){
+          mark[col[r+k]] = 0;
+          if (col[r+k] == i) val[r+k] = (rand()%23 + 1)/(TYPE)1000.0;
+          else               val[r+k] = (rand()%22 + 1)/(TYPE)1000.0;
+          sum += val[r+k];
+       }
+       for(k=0; k<n; k++){
+          if (col[r+k] == i) val[r+k] += sum;
+          val[r+k] /= sum;
+       }
+       r += n;
+    }
+    row_start[Ndim] = r;
+    free(mark);
+
+}
+
+//=========================================================
+// The matrix-free solver's matrix (MM_HASH_ROW and MM_HASH_ELEM in
+// mm_utils.h), stored in full
+//=========================================================
+void init_hashed_diag_dom_matrix(int Ndim, unsigned seed, TYPE *A) {
+
+    int i,j;
+    unsigned key;
+    long sum;
+
+    #pragma omp parallel for private(j, key, sum)
+    for(i=0; i<Ndim; i++){
+       key = MM_HASH_ROW(seed, i);
+       sum = 0;
+       for(j=0; j<Ndim; j++){
+          *(A+(size_t)i*Ndim+j) = (TYPE) MM_HASH_ELEM(key, j);
+          sum += MM_HASH_ELEM(key, j);
+       }
+       for(j=0; j<Ndim; j++){
+          if (j == i) *(A+(size_t)i*Ndim+j) += (TYPE) sum;
+          *(A+(size_t)i*Ndim+j) /= (TYPE) sum;
+       }
+    }
+
+}
+
+//=========================================================
+// Structured test matrices (see mm_utils.h)
+//=========================================================
+void init_toeplitz_matrix(int Ndim, TYPE *t) {
+
+    int d;
+    TYPE sum = (TYPE)0.0;
+
+    for(d=0; d<2*Ndim-1; d++){
+       t[d] = (d == Ndim-1) ? (TYPE)0.0 : (TYPE)(rand()%22 + 1);
+       sum += t[d];
+    }
+    for(d=0; d<2*Ndim-1; d++)
+       t[d] = (d == Ndim-1) ? (TYPE)1.0 : t[d]/(2*sum);
+
+}
+
+void init_circulant_matrix(int Ndim, TYPE *t) {
+
+    int d;
+    TYPE sum = (TYPE)0.0;
+    TYPE *c = t + Ndim-1;     // c[d], d = j-i, the top row
+
+    for(d=1; d<Ndim; d++){
+       c[d] = (TYPE)(rand()%22 + 1);
+       sum += c[d];
+    }
+    c[0] = (TYPE)1.0;
+    for(d=1; d<Ndim; d++) c[d] /= 2*sum;
+    // j-i < 0 wraps round to j-i+Ndim
+    for(d=1; d<Ndim; d++) c[-d] = c[Ndim-d];
+
+}
+
+void init_kron_factor(int n, TYPE *F) {
+
+    size_t i, nn = (size_t)n*n;
+
+    init_diag_dom_near_identity_matrix(n, F);
+    for(i=0; i<(size_t)n; i++) *(F+i*n+i) += (TYPE)4.0;
+    for(i=0; i<nn; i++) F[i] /= (TYPE)5.0;
+
+}
+
+void init_lowrank_matrix(int Ndim, int k, TYPE *d, TYPE *U, TYPE *V) {
+
+    int i,l;
+    size_t m, n = (size_t)Ndim*k;
+    TYPE uv, off;
+    TYPE *vsum = (TYPE *) calloc(k, sizeof(TYPE));
+
+    if (!vsum){
+       printf("\n memory allocation error\n");
+       exit(-1);
+    }
+
+    for(m=0; m<n; m++) U[m] = (rand()%22 + 1)/(TYPE)1000.0;
+    for(m=0; m<n; m++) V[m] = (rand()%22 + 1)/(TYPE)1000.0;
+    for(i=0; i<Ndim; i++)
+       for(l=0; l<k; l++) vsum[l] += V[(size_t)i*k+l];
+
+    // everything is positive, so the rest of row i adds up to
+    // U[i].(sum of the rows of V) less U[i].V[i].  U[i] is scaled
+    // to make that 1/2, and D[i] to put 1 and a bit on the diagonal.
+    for(i=0; i<Ndim; i++){
+       uv = off = (TYPE)0.0;
+       for(l=0; l<k; l++){
+          uv  += U[(size_t)i*k+l]*V[(size_t)i*k+l];
+          off += U[(size_t)i*k+l]*vsum[l];
+       }
+       off -= uv;
+       if (off > (TYPE)0.0){
+          for(l=0; l<k; l++) U[(size_t)i*k+l] *= (TYPE)0.5/off;
+          uv *= (TYPE)0.5/off;
+       }
+       d[i] = (TYPE)1.0 + (rand()%23 + 1)/(TYPE)1000.0 - uv;
+    }
+    free(vsum);
+
+}
+
+//=========================================================
+// A random permutation of 0 to n-1 (Fisher-Yates)
+//=========================================================
+void mm_random_permutation(int n, int *perm) {
+
+    int i,j,t;
+
+    for(i=0; i<n; i++) perm[i] = i;
+    for(i=n-1; i>0; i--){
+       j = sparse_rand(i+1);
+       t = perm[i]; perm[i] = perm[j]; perm[j] = t;
+    }
+
+}
+
+//=========================================================
+// The same matrix as init_diag_dom_near_identity_matrix (for the
+// same rand() sequence), worked out in TYPE and stored in float
+// for the mixed precision solvers.
+//=========================================================
+void init_diag_dom_near_identity_matrix_f(int Ndim,  float *A) {
+
+    int i,j;
+    TYPE sum, val;
+
+    for(i=0; i<Ndim; i++){
+       sum = (TYPE)0.0;
+       for(j=0; j<Ndim; j++){
+           // rand()%23 is held exactly in a float until the row is done
+           *(A+i*Ndim+j) = (float)(rand()%23);
+           sum += *(A+i*Ndim+j)/(TYPE)1000.0;
+       }
+       for(j=0; j<Ndim; j++){
+           val = *(A+i*Ndim+j)/(TYPE)1000.0;
+           if (j == i) val += sum;
+           *(A+i*Ndim+j) = (float)(val/sum);
+       }
+    }
+
 }   
 //===========================================================
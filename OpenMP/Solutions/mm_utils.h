@@ -1,3 +1,6 @@
+#ifndef MM_UTILS_H
+#define MM_UTILS_H
+
 #include <omp.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,6 +16,20 @@ double errsqr (int Ndim, int Mdim, TYPE* C, TYPE* Cref);
 
 void mm_clear (int Ndim, int Mdim, TYPE* C); 
 
+// aligned, huge page backed allocation for big arrays (see mm_utils.c)
+#define MM_ALIGN       64
+#define MM_HUGE_PAGE   (2*1024*1024)
+
+void *mm_malloc (size_t bytes);
+
+void  mm_free (void *p);
+
+void  mm_alloc_report (const char *name, const void *p);
+
+void mm_first_touch (int Ndim, int Mdim, TYPE* C); 
+
+void mm_first_touch_f (int Ndim, int Mdim, float* C); 
+
 void mm_print (int Ndim, int Mdim, TYPE* C); 
 
 void init_const_matrix (int Ndim,  int Mdim,  int Pdim, 
@@ -30,3 +47,107 @@ void mm_tst_cases(int NTRIALS, int Ndim, int Mdim, int Pdim, TYPE* A, TYPE* B, T
 void init_diag_dom_matrix(int Ndim,  TYPE *A);
 
 void init_diag_dom_near_identity_matrix(int Ndim,  TYPE *A);
+
+// Symmetric positive definite test matrices, in full or packed.
+// Packed storage keeps the upper triangle row by row: element (i,j),
+// j >= i, is at PACKED_INDEX(Ndim,i,j) of PACKED_SIZE(Ndim).
+#define PACKED_INDEX(Ndim,i,j) \
+        ((size_t)(i)*(Ndim) - (size_t)(i)*((i)-1)/2 + ((j)-(i)))
+#define PACKED_SIZE(Ndim)      ((size_t)(Ndim)*((Ndim)+1)/2)
+
+void init_spd_matrix(int Ndim,  TYPE *A);
+
+void init_spd_packed_matrix(int Ndim,  TYPE *Ap);
+
+// Banded test matrices stored by diagonals (DIA): the 2*bw+1
+// diagonals from A[i][i-bw] to A[i][i+bw] are each Ndim long, and
+// element (i,j), |j-i| <= bw, is at BAND_INDEX(Ndim,bw,i,j) of
+// BAND_SIZE(Ndim,bw).  Slots that fall outside the matrix are zero.
+#define BAND_INDEX(Ndim,bw,i,j) \
+        ((size_t)((j)-(i)+(bw))*(Ndim) + (i))
+#define BAND_SIZE(Ndim,bw)     ((size_t)(2*(bw)+1)*(Ndim))
+
+void init_banded_near_identity_matrix(int Ndim, int bw, TYPE *Ab);
+
+// Sparse test matrices in compressed sparse row (CSR) form: row i
+// holds elements row_start[i] to row_start[i+1]-1 of val, with
+// their column numbers in col, in increasing order.  The generator
+// gives every row nzr nonzeros, the diagonal and nzr-1 others in
+// random columns, so the arrays need Ndim+1 and Ndim*nzr elements.
+void init_sparse_near_identity_matrix(int Ndim, int nzr, size_t *row_start,
+                                      int *col, TYPE *val);
+
+// The same with the nonzeros of each row drawn from a window of
+// 2*bw+1 columns around the diagonal (or nzr, if that's wider)
+void init_sparse_banded_near_identity_matrix(int Ndim, int nzr, int bw,
+                            size_t *row_start, int *col, TYPE *val);
+
+// Sparse rows whose lengths follow a power law, as the degrees of
+// a web or social network graph do: row i has about 2 + K/(i+1)
+// nonzeros (at most Ndim) in random columns, with K set for about
+// nzr per row on average, so the longest rows come first.
+// mm_powerlaw_nnz() gives the size of col and val.
+size_t mm_powerlaw_nnz(int Ndim, int nzr);
+void init_sparse_powerlaw_matrix(int Ndim, int nzr, size_t *row_start,
+                                 int *col, TYPE *val);
+
+// Matrix-free test matrices: the same kind of matrix as
+// init_diag_dom_near_identity_matrix, with rand()%23 replaced by a
+// counter-based hash of the element's row and column, so any element
+// can be worked out again when it's needed instead of being stored.
+// Row i's raw elements are MM_HASH_ELEM(MM_HASH_ROW(seed,i),j), 0
+// to 22; A[i][j] is that over the row's sum S, plus 1 on the
+// diagonal.  init_hashed_diag_dom_matrix() stores the same matrix.
+static inline unsigned mm_hash32(unsigned x)
+{
+    x ^= x >> 16;  x *= 0x7feb352dU;
+    x ^= x >> 15;  x *= 0x846ca68bU;
+    x ^= x >> 16;
+    return x;
+}
+#define MM_HASH_ROW(seed,i)  mm_hash32((seed) ^ mm_hash32((unsigned)(i)))
+#define MM_HASH_ELEM(key,j) \
+        ((int)(((mm_hash32((key) + (unsigned)(j)) >> 8)*23U) >> 24))
+
+void init_hashed_diag_dom_matrix(int Ndim, unsigned seed, TYPE *A);
+
+// Structured test matrices.  A Toeplitz A is stored by its 2*Ndim-1
+// diagonals, A[i][j] at TOEP_INDEX(Ndim,i,j), the main one in the
+// middle.  The generators draw the off-diagonal elements like the
+// others (rand()%22+1) and scale them to add up to 1/2 with a 1 on
+// the diagonal, so Jacobi converges at the same rate for any Ndim.
+// The circulant one stores A[i][j] = c[(j-i) mod Ndim] the same way.
+#define TOEP_INDEX(Ndim,i,j)  ((size_t)((Ndim)-1+(j)-(i)))
+
+void init_toeplitz_matrix(int Ndim, TYPE *t);
+void init_circulant_matrix(int Ndim, TYPE *t);
+
+// A factor for a Kronecker product test matrix: the near identity
+// matrix with 4 added to the diagonal and then divided by 5, so
+// each row is 1 and a bit on the diagonal and 1/5 off it.  The
+// product of two has 1.2*1.2-1 = 0.44 off the diagonal.
+void init_kron_factor(int n, TYPE *F);
+
+// A = D + U*V^T with U and V Ndim by k (row major) drawn like the
+// others, U's rows scaled so the off-diagonal elements of each row
+// of A add up to 1/2, and D set to put 1 and a bit on the diagonal.
+void init_lowrank_matrix(int Ndim, int k, TYPE *d, TYPE *U, TYPE *V);
+
+// A random permutation of 0 to n-1
+void mm_random_permutation(int n, int *perm);
+
+// Mixed precision: the Jacobi programs built with -DMIXED store A
+// in float (ATYPE) and keep the vectors and sums in TYPE
+#ifdef MIXED
+#define ATYPE   float
+#define init_diag_dom_near_identity_matrix_a init_diag_dom_near_identity_matrix_f
+#define mm_first_touch_a mm_first_touch_f
+#else
+#define ATYPE   TYPE
+#define init_diag_dom_near_identity_matrix_a init_diag_dom_near_identity_matrix
+#define mm_first_touch_a mm_first_touch
+#endif
+
+void init_diag_dom_near_identity_matrix_f(int Ndim,  float *A);
+
+#endif